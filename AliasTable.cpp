@@ -0,0 +1,147 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * AliasTable.cpp: Definition of the AliasTable class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AliasTable.h"
+#include "MarkovChain.h"
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty table. Sampling an empty table returns NULL
+AliasTable::AliasTable()
+{
+	total = 0;
+}
+
+
+// Initializes the table from the given links, using the counts of the given direction
+AliasTable::AliasTable(const WordLinks& links, int direction)
+{
+	total = 0;
+	build(links, direction);
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Builds the table using Vose's method. Direction is GENERATE_PREFIX or GENERATE_POSTFIX
+// and selects which of the two counts in each WordLink is used as its weight.
+void AliasTable::build(const WordLinks& links, int direction)
+{
+	words.clear();
+	aliases.clear();
+	thresholds.clear();
+	total = 0;
+
+	// Each column starts out holding its own count scaled by the number of columns. A
+	// column is full when it holds exactly total, the average of the scaled counts.
+	vector<long long> scaled;
+
+	auto i = links.begin();
+	for(; i != links.end(); i++)
+	{
+		int count = (direction == GENERATE_PREFIX) ? i->second.prefixOccurrences : i->second.postfixOccurrences;
+		if(count <= 0)
+			continue;
+
+		words.push_back(i->second.word);
+		scaled.push_back(count);
+		total += count;
+	}
+
+	int n = words.size();
+	if(n == 0)
+		return;
+
+	aliases.resize(n);
+	thresholds.resize(n);
+
+	// Split the columns into those with too little and too much weight
+	vector<int> small;
+	vector<int> large;
+
+	for(int j = 0; j < n; j++)
+	{
+		scaled[j] *= n;
+		aliases[j] = j;
+
+		if(scaled[j] < total)
+			small.push_back(j);
+		else
+			large.push_back(j);
+	}
+
+	// Fill each underfull column with the excess of an overfull one. The overfull column
+	// gives up exactly what is needed, and is requeued according to what it has left.
+	while(!small.empty() && !large.empty())
+	{
+		int s = small.back();
+		small.pop_back();
+		int l = large.back();
+		large.pop_back();
+
+		thresholds[s] = scaled[s];
+		aliases[s] = l;
+
+		scaled[l] -= total - scaled[s];
+
+		if(scaled[l] < total)
+			small.push_back(l);
+		else
+			large.push_back(l);
+	}
+
+	// Whatever is left is full. All integer arithmetic, so there is no rounding residue
+	// except in columns that are already exactly full.
+	for(unsigned int j = 0; j < large.size(); j++)
+		thresholds[large[j]] = total;
+	for(unsigned int j = 0; j < small.size(); j++)
+		thresholds[small[j]] = total;
+}
+
+
+// Chooses a random word, weighted by the counts the table was built from. The table is
+// never changed by sampling, so any number of threads may share it.
+Word* AliasTable::sample(Random& random) const
+{
+	if(words.empty())
+		return NULL;
+
+	// Pick a column uniformly, then decide between its own word and its alias. A Word's counts
+	// sum to an int, so the total is always a bound nextInt can take
+	int column = random.nextInt(words.size());
+	long long r = random.nextInt(total);
+
+	if(r < thresholds[column])
+		return words[column];
+
+	return words[aliases[column]];
+}
+
+
+// Returns true if there were no links with a non-zero count when the table was built
+bool AliasTable::isEmpty() const
+{
+	return words.empty();
+}
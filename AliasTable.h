@@ -0,0 +1,60 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * AliasTable.h: Declaration of the AliasTable class. Samples a Word's links in constant time.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include "WordLink.h"
+#include "Random.h"
+#include <vector>
+#include <map>
+
+class Word;
+
+using namespace std;
+
+// A Walker/Vose alias table over the prefix or postfix counts of a Word's links.
+// Once built, choosing a weighted random Word costs two random numbers and one
+// comparison, no matter how many links the Word has. The table is a snapshot, so
+// it must be rebuilt whenever the counts it was built from change.
+class AliasTable
+{
+private:
+	// The candidate words, one column per link with a non-zero count
+	vector<Word*> words;
+
+	// For each column, the column to use when the threshold test fails
+	vector<int> aliases;
+
+	// For each column, the part of the column (out of total) that belongs to its own word
+	vector<long long> thresholds;
+
+	// The sum of all counts the table was built from
+	long long total;
+
+public:
+	AliasTable();
+	AliasTable(const WordLinks&, int);
+
+	void build(const WordLinks&, int);
+	Word* sample(Random&) const;
+	bool isEmpty() const;
+};
+
+#endif
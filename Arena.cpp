@@ -0,0 +1,133 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Arena.cpp: Definition of the Arena class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Arena.h"
+#include <cstring>
+
+// The size of each chunk. Larger blocks get a chunk of their own
+#define ARENA_CHUNK_SIZE 65536
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty arena. Nothing is allocated until the first block is asked for
+Arena::Arena()
+{
+	chunkUsed = 0;
+	chunkBytes = 0;
+	memset(freeLists, 0, sizeof(freeLists));
+}
+
+
+// Frees every chunk
+Arena::~Arena()
+{
+	release();
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Returns a block of at least the given size. A block of the same size given back earlier
+// is reused first, and otherwise the block is carved from the last chunk.
+void* Arena::allocate(size_t size)
+{
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	if(size == 0)
+		size = ARENA_ALIGNMENT;
+
+	if(size <= ARENA_MAX_POOLED)
+	{
+		void*& freeList = freeLists[size / ARENA_ALIGNMENT];
+		if(freeList != NULL)
+		{
+			void* block = freeList;
+			freeList = *(void**)block;
+			return block;
+		}
+	}
+
+	// A block too large for a chunk gets a chunk of its own. It's inserted before the last
+	// chunk so that the last chunk can still be filled.
+	if(size > ARENA_CHUNK_SIZE)
+	{
+		char* chunk = new char[size];
+		chunks.insert(chunks.end() - (chunks.empty() ? 0 : 1), chunk);
+		chunkBytes += size;
+
+		return chunk;
+	}
+
+	if(chunks.empty() || chunkUsed + size > ARENA_CHUNK_SIZE)
+	{
+		chunks.push_back(new char[ARENA_CHUNK_SIZE]);
+		chunkUsed = 0;
+		chunkBytes += ARENA_CHUNK_SIZE;
+	}
+
+	void* block = chunks.back() + chunkUsed;
+	chunkUsed += size;
+
+	return block;
+}
+
+
+// Takes back a block of the given size, which must be the size it was allocated with.
+// Small blocks are kept for reuse. Larger ones stay unused until the arena is released.
+void Arena::deallocate(void* block, size_t size)
+{
+	if(block == NULL)
+		return;
+
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	if(size == 0)
+		size = ARENA_ALIGNMENT;
+
+	if(size <= ARENA_MAX_POOLED)
+	{
+		void*& freeList = freeLists[size / ARENA_ALIGNMENT];
+		*(void**)block = freeList;
+		freeList = block;
+	}
+}
+
+
+// Frees every chunk at once. Every block the arena handed out becomes invalid.
+void Arena::release()
+{
+	for(unsigned int i = 0; i < chunks.size(); i++)
+		delete[] chunks[i];
+
+	chunks.clear();
+	chunkUsed = 0;
+	chunkBytes = 0;
+	memset(freeLists, 0, sizeof(freeLists));
+}
+
+
+// Returns the number of bytes held by the arena's chunks
+size_t Arena::getMemoryUsage() const
+{
+	return chunkBytes;
+}
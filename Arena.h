@@ -0,0 +1,111 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Arena.h: Declaration of the Arena class. Hands out small blocks of memory carved from large ones.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+// Every block handed out by an Arena starts on a multiple of this
+#define ARENA_ALIGNMENT 8
+
+// The largest block whose memory is kept for reuse when it's given back
+#define ARENA_MAX_POOLED 256
+
+// Allocates small blocks of memory by moving a pointer through large chunks. Blocks given
+// back are kept on a free list for their size, so a freed tree node is reused by the next
+// node, but memory is only returned to the system when the whole arena is released at once.
+// Releasing costs one delete per chunk, no matter how many blocks were handed out.
+//
+// An arena is not safe to use from several threads at once.
+class Arena
+{
+private:
+	// Chunks of memory. Blocks are carved from the last one
+	vector<char*> chunks;
+
+	// The number of bytes used in the last chunk, and allocated in all chunks
+	size_t chunkUsed;
+	size_t chunkBytes;
+
+	// The first free block of each size, by size in units of ARENA_ALIGNMENT. Each free
+	// block holds a pointer to the next free block of its size.
+	void* freeLists[ARENA_MAX_POOLED / ARENA_ALIGNMENT + 1];
+
+	// Arenas own their chunks, so they aren't copied
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+public:
+	Arena();
+	~Arena();
+
+	void* allocate(size_t);
+	void deallocate(void*, size_t);
+	void release();
+	size_t getMemoryUsage() const;
+};
+
+// A standard allocator that takes its memory from an Arena, so that containers such as
+// map can keep their nodes in one. Every copy refers to the same arena.
+template<class T>
+class ArenaAllocator
+{
+	static_assert(alignof(T) <= ARENA_ALIGNMENT, "ArenaAllocator can't align this type");
+
+	template<class U> friend class ArenaAllocator;
+
+private:
+	Arena* arena;
+
+public:
+	typedef T value_type;
+
+	ArenaAllocator(Arena* arena) : arena(arena) {}
+
+	template<class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t count)
+	{
+		return (T*)arena->allocate(count * sizeof(T));
+	}
+
+	void deallocate(T* block, size_t count)
+	{
+		arena->deallocate(block, count * sizeof(T));
+	}
+
+	template<class U>
+	bool operator==(const ArenaAllocator<U>& other) const
+	{
+		return arena == other.arena;
+	}
+
+	template<class U>
+	bool operator!=(const ArenaAllocator<U>& other) const
+	{
+		return arena != other.arena;
+	}
+};
+
+#endif
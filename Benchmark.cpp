@@ -0,0 +1,1076 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Benchmark.cpp: Timing harness for the chain's hot paths.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MarkovChain.h"
+#include "Word.h"
+#include "FrozenChain.h"
+#include "GenerationBuffer.h"
+#include "Tokenizer.h"
+#include "CheckpointLog.h"
+#include "ConcurrentChain.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace std::chrono;
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Allocation Counting --------------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// The number of heap allocations made by the whole program so far
+atomic<long long> allocationCount(0);
+
+
+// Counts every allocation made through new
+void* operator new(size_t size)
+{
+	allocationCount.fetch_add(1, memory_order_relaxed);
+
+	void* memory = malloc(size == 0 ? 1 : size);
+	if(memory == NULL)
+		throw bad_alloc();
+
+	return memory;
+}
+
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+
+// Returns the number of bytes of the process resident in memory, or 0 where it can't be read
+size_t residentMemory()
+{
+#ifdef __linux__
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if(statm == NULL)
+		return 0;
+
+	unsigned long size = 0;
+	unsigned long resident = 0;
+	if(fscanf(statm, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+
+	fclose(statm);
+	return resident * sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Corpus Generation ----------------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Spells out the given number using only letters so that cleanTokens leaves it intact
+string makeWord(int index)
+{
+	string word;
+
+	do
+	{
+		word.push_back('a' + index % 26);
+		index /= 26;
+	}
+	while(index > 0);
+
+	return word;
+}
+
+
+// Builds a corpus in which a handful of hub words are followed by nearly every word in the
+// vocabulary, the worst case for a linear walk over a Word's links
+string makeHubCorpus(int sentenceCount, int vocabularySize)
+{
+	const char* hubs[] = {"the", "a", "of", "and"};
+	const int hubCount = 4;
+
+	string corpus;
+
+	for(int i = 0; i < sentenceCount; i++)
+	{
+		for(int j = 0; j < 6; j++)
+		{
+			corpus.append(hubs[rand() % hubCount]);
+			corpus.append(" ");
+			corpus.append(makeWord(rand() % vocabularySize));
+			corpus.append(" ");
+		}
+
+		corpus.append(". ");
+	}
+
+	return corpus;
+}
+
+
+// Builds a corpus of sentences of 4 to 16 words, each word drawn from the vocabulary with a
+// Zipf distribution of the given exponent, the way word frequencies fall off in real text
+string makeZipfCorpus(int sentenceCount, int vocabularySize, double exponent)
+{
+	vector<double> cumulative(vocabularySize);
+	double total = 0;
+
+	for(int i = 0; i < vocabularySize; i++)
+	{
+		total += 1.0 / pow(i + 1, exponent);
+		cumulative[i] = total;
+	}
+
+	Random random(1);
+	string corpus;
+
+	for(int i = 0; i < sentenceCount; i++)
+	{
+		int length = 4 + random.nextInt(13);
+
+		for(int j = 0; j < length; j++)
+		{
+			// 53 random bits scaled to the total weight
+			double r = (random.next() >> 11) * (total / 9007199254740992.0);
+			int index = upper_bound(cumulative.begin(), cumulative.end(), r) - cumulative.begin();
+
+			corpus.append(makeWord(min(index, vocabularySize - 1)));
+			corpus.append(" ");
+		}
+
+		corpus.append(". ");
+	}
+
+	return corpus;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Benchmarks -----------------------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Generates the given number of strings and reports the rate in words per second. Both
+// directions are exercised by seeding from a hub word. Works with MarkovChain and FrozenChain.
+template<class Chain>
+void benchGeneration(Chain& chain, const char* label, int iterations)
+{
+	const int maxWordCount = 50;
+	long long wordCount = 0;
+
+	// Build any lazily created structures before timing
+	chain.generateString(string("the"), maxWordCount);
+
+	steady_clock::time_point begin = steady_clock::now();
+
+	for(int i = 0; i < iterations; i++)
+	{
+		string s = chain.generateString(string("the"), maxWordCount);
+
+		for(unsigned int j = 0; j < s.length(); j++)
+		{
+			if(s[j] == ' ')
+				wordCount++;
+		}
+	}
+
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+
+	printf("%-24s %10d strings %12lld words %9.3f s %14.0f words/s\n",
+		label, iterations, wordCount, seconds, wordCount / seconds);
+}
+
+
+// Times each of the given number of generateString calls on its own and reports the
+// latency percentiles in microseconds. Works with MarkovChain and FrozenChain.
+template<class Chain>
+void benchLatency(const Chain& chain, const char* label, int iterations)
+{
+	const int maxWordCount = 50;
+	vector<double> latencies(iterations);
+	Random random(1);
+
+	for(int i = 0; i < iterations; i++)
+	{
+		steady_clock::time_point begin = steady_clock::now();
+		chain.generateString(maxWordCount, random);
+		latencies[i] = duration<double, micro>(steady_clock::now() - begin).count();
+	}
+
+	sort(latencies.begin(), latencies.end());
+
+	printf("%-24s p50 %8.2f us  p90 %8.2f us  p99 %8.2f us  p99.9 %8.2f us  max %8.2f us\n", label,
+		latencies[iterations * 50 / 100], latencies[iterations * 90 / 100], latencies[iterations * 99 / 100],
+		latencies[iterations * 999 / 1000], latencies[iterations - 1]);
+}
+
+
+// Measures the chain's main operations on a Zipf distributed corpus: how quickly addText
+// takes it in and how much memory the chain holds afterward, the latency of each
+// generateString call, and how long saving and the two ways of loading take
+void benchZipf(int sentenceCount, int vocabularySize, int iterations, double exponent)
+{
+	printf("Zipf: %d sentences, %d word vocabulary, exponent %.2f\n", sentenceCount, vocabularySize, exponent);
+
+	string corpus = makeZipfCorpus(sentenceCount, vocabularySize, exponent);
+
+	// Training
+	MarkovChain chain;
+	chain.setOrder(1);
+
+	size_t residentBefore = residentMemory();
+	long long allocations = allocationCount.load();
+	steady_clock::time_point begin = steady_clock::now();
+	chain.addText(corpus);
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+	allocations = allocationCount.load() - allocations;
+	size_t residentAfter = residentMemory();
+
+	printf("%-24s %10d sentences %9.3f s %14.0f sentences/s %9.2f MB/s\n", "addText",
+		sentenceCount, seconds, sentenceCount / seconds, corpus.length() / seconds / 1048576);
+	printf("%-24s %10lld allocations %10.2f MB resident\n", "training memory",
+		allocations, (double)(residentAfter - residentBefore) / 1048576);
+
+	// Clearing is timed on a copy of the training, so the chain above is kept for generation
+	MarkovChain cleared;
+	cleared.setOrder(1);
+	cleared.addText(corpus);
+
+	begin = steady_clock::now();
+	cleared.clear();
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10s    %9.6f s\n", "clear", "", seconds);
+
+	// Generation
+	chain.setSamplingMode(SAMPLE_CUMULATIVE);
+	benchLatency(chain, "latency, cumulative", iterations);
+
+	chain.setSamplingMode(SAMPLE_ALIAS);
+	benchLatency(chain, "latency, alias", iterations);
+
+	chain.setGenerationPolicy(GenerationPolicy(10, 1));
+	benchLatency(chain, "latency, top 10", iterations);
+
+	chain.setGenerationPolicy(GenerationPolicy(10, 0.7));
+	benchLatency(chain, "latency, top 10 at 0.7", iterations);
+
+	chain.setGenerationPolicy(GenerationPolicy(0, 1, 4));
+	benchLatency(chain, "latency, beam of 4", iterations);
+
+	chain.setGenerationPolicy(GenerationPolicy());
+
+	FrozenChain frozen = chain.freeze();
+	benchLatency(frozen, "latency, frozen", iterations);
+
+	// Persistence
+	const char* fileName = "marqov_bench.chain";
+
+	begin = steady_clock::now();
+	chain.save(fileName);
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10.2f MB %9.3f s\n", "save", (double)frozen.getMemoryUsage() / 1048576, seconds);
+
+	MarkovChain loadedChain;
+	begin = steady_clock::now();
+	loadedChain.load(fileName);
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10s    %9.3f s\n", "load", "", seconds);
+
+	// The same on several threads, which write and read the same file
+	int maxThreads = thread::hardware_concurrency();
+	if(maxThreads < 4)
+		maxThreads = 4;
+
+	for(int threadCount = 2; threadCount <= maxThreads; threadCount *= 2)
+	{
+		char label[32];
+
+		begin = steady_clock::now();
+		chain.save(fileName, threadCount);
+		seconds = duration<double>(steady_clock::now() - begin).count();
+		snprintf(label, sizeof(label), "save, %d threads", threadCount);
+		printf("%-24s %10s    %9.3f s\n", label, "", seconds);
+
+		MarkovChain threadLoadedChain;
+		begin = steady_clock::now();
+		threadLoadedChain.load(fileName, threadCount);
+		seconds = duration<double>(steady_clock::now() - begin).count();
+		snprintf(label, sizeof(label), "load, %d threads", threadCount);
+		printf("%-24s %10s    %9.3f s\n", label, "", seconds);
+	}
+
+	FrozenChain mapped;
+	begin = steady_clock::now();
+	mapped.load(fileName, true);
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10s    %9.3f s\n", "map, verified", "", seconds);
+
+	begin = steady_clock::now();
+	mapped.load(fileName, false);
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10s    %9.3f s\n", "map, unverified", "", seconds);
+
+	remove(fileName);
+}
+
+
+// Persists a chain as text keeps arriving, once with save and once with checkpoint, and
+// reports the time each takes per batch, then how long loading the file and its log takes
+void benchCheckpoint(int sentenceCount, int vocabularySize, double exponent)
+{
+	const int batchCount = 20;
+	printf("Checkpoint: %d sentences, then %d batches of 1%% more\n", sentenceCount, batchCount);
+
+	string corpus = makeZipfCorpus(sentenceCount, vocabularySize, exponent);
+	vector<string> batches;
+	for(int i = 0; i < batchCount; i++)
+		batches.push_back(makeZipfCorpus(sentenceCount / 100 + 1, vocabularySize, exponent));
+
+	const char* fileName = "marqov_bench.chain";
+	string logName = string(fileName) + LOG_SUFFIX;
+
+	for(int incremental = 0; incremental < 2; incremental++)
+	{
+		MarkovChain chain;
+		chain.addText(corpus);
+		chain.compact(fileName);
+
+		double seconds = 0;
+		for(int i = 0; i < batchCount; i++)
+		{
+			chain.addText(batches[i]);
+
+			steady_clock::time_point begin = steady_clock::now();
+			if(incremental)
+				chain.checkpoint(fileName);
+			else
+				chain.save(fileName);
+			seconds += duration<double>(steady_clock::now() - begin).count();
+		}
+
+		printf("%-24s %10d batches %9.6f s per batch\n", incremental ? "checkpoint" : "save", batchCount, seconds / batchCount);
+	}
+
+	MarkovChain loadedChain;
+	steady_clock::time_point begin = steady_clock::now();
+	loadedChain.load(fileName);
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10s    %9.3f s\n", "load with log", "", seconds);
+
+	remove(fileName);
+	remove(logName.c_str());
+}
+
+
+// Prunes a chain trained on a Zipf corpus and reports the memory before and after, then trains
+// the same corpus in batches under a budget of half that memory
+void benchPruning(int sentenceCount, int vocabularySize, double exponent)
+{
+	printf("Pruning: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	string corpus = makeZipfCorpus(sentenceCount, vocabularySize, exponent);
+
+	MarkovChain chain;
+	chain.addText(corpus);
+	size_t unpruned = chain.getMemoryUsage();
+
+	steady_clock::time_point begin = steady_clock::now();
+	chain.prune(2, 0);
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10.2f MB %9.3f s %10.2f MB after\n", "prune(2, 0)", (double)unpruned / 1048576, seconds, (double)chain.getMemoryUsage() / 1048576);
+
+	// Feed the corpus in about 20 batches of whole sentences
+	MarkovChain budgeted;
+	budgeted.setMemoryBudget(unpruned / 2);
+
+	size_t largest = 0;
+	begin = steady_clock::now();
+
+	for(size_t first = 0; first < corpus.length();)
+	{
+		size_t last = corpus.find('.', first + corpus.length() / 20);
+		last = (last == string::npos) ? corpus.length() : last + 1;
+
+		budgeted.addText(string_view(corpus).substr(first, last - first));
+		largest = max(largest, budgeted.getMemoryUsage());
+		first = last;
+	}
+
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10.2f MB %9.3f s %10.2f MB largest\n", "addText under budget", (double)(unpruned / 2) / 1048576,
+		seconds, (double)largest / 1048576);
+}
+
+
+// Trains one chain per shard of a Zipf corpus, as separate machines would, and times merging
+// them into one against training that one chain on the whole corpus
+void benchMerging(int sentenceCount, int vocabularySize, double exponent)
+{
+	const int shardCount = 4;
+	printf("Merging: %d shards of %d sentences\n", shardCount, sentenceCount / shardCount);
+
+	vector<string> corpora;
+	for(int i = 0; i < shardCount; i++)
+		corpora.push_back(makeZipfCorpus(sentenceCount / shardCount, vocabularySize, exponent));
+
+	vector<MarkovChain> shards(shardCount);
+	for(int i = 0; i < shardCount; i++)
+		shards[i].addText(corpora[i]);
+
+	steady_clock::time_point begin = steady_clock::now();
+	MarkovChain whole;
+	for(int i = 0; i < shardCount; i++)
+		whole.addText(corpora[i]);
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10d shards %9.3f s\n", "addText", shardCount, seconds);
+
+	begin = steady_clock::now();
+	MarkovChain merged;
+	for(int i = 0; i < shardCount; i++)
+		merged.merge(shards[i]);
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10d shards %9.3f s\n", "merge", shardCount, seconds);
+}
+
+
+// Trains a chain in the given sampling mode a little at a time, generating a few strings
+// after each part, the way a chain that learns while it's in use is driven
+void benchInterleaved(int mode, const char* label, int sentenceCount, int vocabularySize)
+{
+	const int rounds = 100;
+	const int maxWordCount = 50;
+
+	srand(1);
+
+	MarkovChain chain;
+	chain.setOrder(1);
+	chain.setSamplingMode(mode);
+
+	steady_clock::time_point begin = steady_clock::now();
+
+	for(int i = 0; i < rounds; i++)
+	{
+		chain.addText(makeHubCorpus(sentenceCount / rounds, vocabularySize));
+
+		for(int j = 0; j < 10; j++)
+			chain.generateString(string("the"), maxWordCount);
+	}
+
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10d rounds  %9.3f s\n", label, rounds, seconds);
+}
+
+
+// Compares cumulative and alias sampling on a corpus with very high fan-out hub words, on a
+// trained chain and on one that is generated from while it's trained
+void benchSampling(int sentenceCount, int vocabularySize, int iterations)
+{
+	printf("Sampling: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	MarkovChain chain;
+	chain.setOrder(1);
+	chain.addText(makeHubCorpus(sentenceCount, vocabularySize));
+
+	chain.setSamplingMode(SAMPLE_CUMULATIVE);
+	benchGeneration(chain, "cumulative search", iterations);
+
+	chain.setSamplingMode(SAMPLE_ALIAS);
+	benchGeneration(chain, "alias table", iterations);
+
+	benchInterleaved(SAMPLE_CUMULATIVE, "interleaved, cumulative", sentenceCount, vocabularySize);
+	benchInterleaved(SAMPLE_ALIAS, "interleaved, alias", sentenceCount, vocabularySize);
+}
+
+
+// Compares generation from a live chain in alias mode with generation from a frozen
+// snapshot of it, and reports how compact the snapshot is
+void benchFrozen(int sentenceCount, int vocabularySize, int iterations)
+{
+	printf("Frozen: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	MarkovChain chain;
+	chain.setOrder(1);
+	chain.setSamplingMode(SAMPLE_ALIAS);
+	chain.addText(makeHubCorpus(sentenceCount, vocabularySize));
+
+	steady_clock::time_point begin = steady_clock::now();
+	FrozenChain frozen = chain.freeze();
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+
+	printf("%-24s %10u words %12u edges %9.3f s %11.2f bytes/edge\n", "freeze",
+		frozen.getWordCount(), frozen.getEdgeCount(), seconds, (double)frozen.getMemoryUsage() / frozen.getEdgeCount());
+
+	begin = steady_clock::now();
+	FrozenChain packed = chain.freeze(FROZEN_EDGES_PACKED);
+	seconds = duration<double>(steady_clock::now() - begin).count();
+
+	printf("%-24s %10u words %12u edges %9.3f s %11.2f bytes/edge\n", "freeze (packed)",
+		packed.getWordCount(), packed.getEdgeCount(), seconds, (double)packed.getMemoryUsage() / packed.getEdgeCount());
+	printf("%-24s %10s       %12s       %9s   %11.2f bytes/edge\n", "live chain", "", "", "",
+		(double)chain.getMemoryUsage() / frozen.getEdgeCount());
+
+	benchGeneration(chain, "live chain (alias)", iterations);
+	benchGeneration(frozen, "frozen chain", iterations);
+	benchGeneration(packed, "frozen chain (packed)", iterations);
+}
+
+
+// Generates the given number of strings from the start word only, and then as many around
+// a seed word in both directions, and reports the time per word of each. Works with
+// MarkovChain and FrozenChain.
+template<class Chain>
+void benchDirections(const Chain& chain, const char* name, int iterations)
+{
+	const int maxWordCount = 50;
+	Random random(1);
+
+	// Build the alias tables of the words generation reaches before timing either direction
+	for(int i = 0; i < iterations; i++)
+		chain.generateString(string("the"), maxWordCount, random);
+
+	for(int seeded = 0; seeded < 2; seeded++)
+	{
+		long long wordCount = 0;
+		steady_clock::time_point begin = steady_clock::now();
+
+		for(int i = 0; i < iterations; i++)
+		{
+			string s = seeded ? chain.generateString(string("the"), maxWordCount, random) : chain.generateString(maxWordCount, random);
+			wordCount += count(s.begin(), s.end(), ' ');
+		}
+
+		double seconds = duration<double>(steady_clock::now() - begin).count();
+
+		char label[32];
+		snprintf(label, sizeof(label), "%s, %s", name, seeded ? "seeded" : "forward");
+		printf("%-24s %10d strings %12lld words %9.3f s %11.1f ns/word\n", label, iterations, wordCount, seconds, seconds * 1e9 / wordCount);
+	}
+}
+
+
+// Compares generating forward from the start word with generating both ways from a seed
+void benchSeeding(int sentenceCount, int vocabularySize, int iterations)
+{
+	printf("Seeding: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	MarkovChain chain;
+	chain.setSamplingMode(SAMPLE_ALIAS);
+	chain.addText(makeHubCorpus(sentenceCount, vocabularySize));
+
+	FrozenChain frozen = chain.freeze();
+
+	benchDirections(chain, "live (alias)", iterations);
+	benchDirections(frozen, "frozen", iterations);
+
+	// Seeds of 8 words, half of them unknown, generating a single word so that the time is
+	// mostly spent resolving the seed
+	vector<string> seeds;
+	for(int i = 0; i < 1000; i++)
+	{
+		string seed;
+		for(int j = 0; j < 8; j++)
+			seed += (j % 2 ? "Unknown" + makeWord(i * 8 + j) : makeWord(i * 8 + j)) + " ";
+
+		seeds.push_back(seed);
+	}
+
+	for(int folded = 0; folded < 2; folded++)
+	{
+		chain.setCaseFolding(folded == 1);
+		Random random(1);
+
+		steady_clock::time_point begin = steady_clock::now();
+		for(int i = 0; i < iterations; i++)
+			chain.generateString(seeds[i % seeds.size()], 1, random);
+		double seconds = duration<double>(steady_clock::now() - begin).count();
+
+		printf("%-24s %10d seeds %9.3f s %11.1f ns/seed\n", folded ? "seed lookup, folded" : "seed lookup", iterations, seconds, seconds * 1e9 / iterations);
+	}
+}
+
+
+// Trains chains of increasing order from the same corpus and reports how quickly they train,
+// the size of their frozen images and how quickly they generate
+void benchOrder(int sentenceCount, int vocabularySize, int iterations)
+{
+	printf("Order: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	string corpus = makeHubCorpus(sentenceCount, vocabularySize);
+
+	for(int order = 1; order <= 4; order++)
+	{
+		MarkovChain chain;
+		chain.setOrder(order);
+		chain.setSamplingMode(SAMPLE_ALIAS);
+
+		steady_clock::time_point begin = steady_clock::now();
+		chain.addText(corpus);
+		double seconds = duration<double>(steady_clock::now() - begin).count();
+
+		char label[32];
+		snprintf(label, sizeof(label), "order %d training", order);
+		printf("%-24s %10d sentences %9.3f s %14.0f sentences/s\n", label, sentenceCount, seconds, sentenceCount / seconds);
+
+		FrozenChain frozen = chain.freeze();
+
+		snprintf(label, sizeof(label), "order %d image", order);
+		printf("%-24s %10u words %12zu bytes\n", label, frozen.getWordCount(), frozen.getMemoryUsage());
+
+		snprintf(label, sizeof(label), "order %d live", order);
+		benchGeneration(chain, label, iterations);
+
+		snprintf(label, sizeof(label), "order %d frozen", order);
+		benchGeneration(frozen, label, iterations);
+	}
+}
+
+
+// Trains chains from the same corpus with increasing numbers of threads and reports the
+// rate in sentences per second
+void benchIngestion(int sentenceCount, int vocabularySize)
+{
+	printf("Ingestion: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	// Split the corpus into several documents, as a caller reading many files would have it
+	vector<string> texts;
+	for(int i = 0; i < 16; i++)
+		texts.push_back(makeHubCorpus(sentenceCount / 16, vocabularySize));
+
+	int maxThreads = thread::hardware_concurrency();
+	if(maxThreads < 4)
+		maxThreads = 4;
+
+	for(int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+	{
+		MarkovChain chain;
+		chain.setOrder(1);
+
+		steady_clock::time_point begin = steady_clock::now();
+		chain.addTexts(texts, threadCount);
+		double seconds = duration<double>(steady_clock::now() - begin).count();
+
+		char label[32];
+		snprintf(label, sizeof(label), "addTexts, %d threads", threadCount);
+		printf("%-24s %10d sentences %9.3f s %14.0f sentences/s\n", label, sentenceCount, seconds, sentenceCount / seconds);
+	}
+}
+
+
+// Scores strings generated from a Zipf corpus as candidates one at a time on the live chain,
+// and in batches on a snapshot of it on several threads, and reports the rate in strings per
+// second
+void benchScoring(int sentenceCount, int vocabularySize, double exponent)
+{
+	printf("Scoring: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	MarkovChain chain;
+	chain.setOrder(1);
+	chain.addText(makeZipfCorpus(sentenceCount, vocabularySize, exponent));
+
+	FrozenChain frozen = chain.freeze();
+
+	Random random(1);
+	vector<string> candidates;
+	for(int i = 0; i < sentenceCount; i++)
+		candidates.push_back(frozen.generateString(50, random));
+
+	vector<string_view> texts(candidates.begin(), candidates.end());
+	vector<SentenceScore> scores;
+
+	steady_clock::time_point begin = steady_clock::now();
+	double sum = 0;
+	for(unsigned int i = 0; i < texts.size(); i++)
+		sum += chain.scoreSentence(texts[i], 0.1).perplexity;
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+
+	printf("%-24s %10zu strings %9.3f s %14.0f strings/s %8.1f perplexity\n", "scoreSentence (live)",
+		texts.size(), seconds, texts.size() / seconds, sum / texts.size());
+
+	int maxThreads = thread::hardware_concurrency();
+	if(maxThreads < 4)
+		maxThreads = 4;
+
+	for(int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+	{
+		begin = steady_clock::now();
+		frozen.scoreMany(texts, 0.1, threadCount, scores);
+		seconds = duration<double>(steady_clock::now() - begin).count();
+
+		char label[32];
+		snprintf(label, sizeof(label), "scoreMany, %d threads", threadCount);
+		printf("%-24s %10zu strings %9.3f s %14.0f strings/s\n", label, texts.size(), seconds, texts.size() / seconds);
+	}
+}
+
+
+// Splits a Zipf corpus into sentences and words with the vectorized tokenizer and with its
+// scalar fallback, and reports the rate of each in megabytes per second
+void benchTokenizer(int sentenceCount, int vocabularySize, int iterations, double exponent)
+{
+	string corpus = makeZipfCorpus(sentenceCount, vocabularySize, exponent);
+	printf("Tokenizer: %.1f MB corpus, %s instructions\n", corpus.length() / 1e6, Tokenizer::getInstructionSet());
+
+	vector<string_view> words;
+	vector<unsigned int> sentenceEnds;
+	int passes = iterations / 50 + 1;
+
+	for(int scalar = 0; scalar < 2; scalar++)
+	{
+		steady_clock::time_point begin = steady_clock::now();
+		for(int i = 0; i < passes; i++)
+		{
+			if(scalar)
+				Tokenizer::tokenizeScalar(corpus, words, sentenceEnds);
+			else
+				Tokenizer::tokenize(corpus, words, sentenceEnds);
+		}
+		double seconds = duration<double>(steady_clock::now() - begin).count();
+
+		printf("%-24s %10zu words %9.3f s %14.1f MB/s\n", scalar ? "tokenizeScalar" : "tokenize", words.size(), seconds, corpus.length() * (double)passes / seconds / 1e6);
+	}
+}
+
+
+// Generates strings one at a time and then in batches into a reused buffer, and reports the
+// rate and the number of heap allocations per string. Works with MarkovChain and FrozenChain.
+// A live chain in alias mode still allocates a table the first time it reaches each word.
+template<class Chain>
+void benchBatches(const Chain& chain, const char* name, int iterations)
+{
+	const int maxWordCount = 50;
+	const int batchSize = 100;
+	int batchCount = (iterations + batchSize - 1) / batchSize;
+	int stringCount = batchCount * batchSize;
+
+	Random random(1);
+	char label[32];
+
+	long long allocations = allocationCount.load();
+	steady_clock::time_point begin = steady_clock::now();
+
+	for(int i = 0; i < stringCount; i++)
+		chain.generateString(maxWordCount, random);
+
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+	allocations = allocationCount.load() - allocations;
+
+	snprintf(label, sizeof(label), "%s, one by one", name);
+	printf("%-24s %10d strings %9.3f s %14.0f strings/s %8.2f allocations/string\n",
+		label, stringCount, seconds, stringCount / seconds, (double)allocations / stringCount);
+
+	// Let the buffer grow to the size of a batch, and any lazily built tables be built,
+	// before counting
+	GenerationBuffer buffer;
+	for(int i = 0; i < batchCount; i++)
+	{
+		buffer.clear();
+		chain.generateBatch(batchSize, maxWordCount, buffer, random);
+	}
+
+	allocations = allocationCount.load();
+	begin = steady_clock::now();
+
+	for(int i = 0; i < batchCount; i++)
+	{
+		buffer.clear();
+		chain.generateBatch(batchSize, maxWordCount, buffer, random);
+	}
+
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	allocations = allocationCount.load() - allocations;
+
+	snprintf(label, sizeof(label), "%s, batches", name);
+	printf("%-24s %10d strings %9.3f s %14.0f strings/s %8.2f allocations/string\n",
+		label, stringCount, seconds, stringCount / seconds, (double)allocations / stringCount);
+}
+
+
+// Compares generating strings one at a time with generating them in batches
+void benchBatching(int sentenceCount, int vocabularySize, int iterations)
+{
+	printf("Batching: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	MarkovChain chain;
+	chain.setOrder(1);
+	chain.setSamplingMode(SAMPLE_ALIAS);
+	chain.addText(makeHubCorpus(sentenceCount, vocabularySize));
+
+	FrozenChain frozen = chain.freeze();
+
+	benchBatches(chain, "live (alias)", iterations);
+	benchBatches(frozen, "frozen", iterations);
+}
+
+
+// Generates from one chain on increasing numbers of threads at once, each thread with its
+// own engine, and reports the combined rate in strings per second. Works with MarkovChain
+// and FrozenChain.
+template<class Chain>
+void benchThreads(const Chain& chain, const char* name, int iterations)
+{
+	const int maxWordCount = 50;
+
+	int maxThreads = thread::hardware_concurrency();
+	if(maxThreads < 4)
+		maxThreads = 4;
+
+	for(int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+	{
+		vector<thread> threads;
+
+		steady_clock::time_point begin = steady_clock::now();
+
+		for(int t = 0; t < threadCount; t++)
+		{
+			threads.push_back(thread([&chain, t, iterations]()
+			{
+				Random random(t + 1);
+
+				for(int i = 0; i < iterations; i++)
+					chain.generateString(string("the"), maxWordCount, random);
+			}));
+		}
+
+		for(unsigned int t = 0; t < threads.size(); t++)
+			threads[t].join();
+
+		double seconds = duration<double>(steady_clock::now() - begin).count();
+		long long stringCount = (long long)iterations * threadCount;
+
+		char label[32];
+		snprintf(label, sizeof(label), "%s, %d threads", name, threadCount);
+		printf("%-24s %10lld strings %9.3f s %14.0f strings/s\n", label, stringCount, seconds, stringCount / seconds);
+	}
+}
+
+
+// Generates from a live chain in alias mode and from a frozen snapshot of it on several
+// threads at once
+void benchConcurrency(int sentenceCount, int vocabularySize, int iterations)
+{
+	printf("Concurrency: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	MarkovChain chain;
+	chain.setOrder(1);
+	chain.setSamplingMode(SAMPLE_ALIAS);
+	chain.addText(makeHubCorpus(sentenceCount, vocabularySize));
+
+	FrozenChain frozen = chain.freeze();
+
+	benchThreads(chain, "live (alias)", iterations);
+	benchThreads(frozen, "frozen", iterations);
+}
+
+
+// Generates on several threads and records the latency of each call until told to stop,
+// then reports the percentiles over all threads. Returns the number of strings generated.
+long long benchReaders(const ConcurrentChain& chain, const char* label, int threadCount, atomic<bool>& stop)
+{
+	const int maxWordCount = 50;
+	vector<vector<double> > latencies(threadCount);
+	vector<thread> threads;
+
+	for(int t = 0; t < threadCount; t++)
+	{
+		threads.push_back(thread([&chain, &latencies, &stop, t]()
+		{
+			Random random(t + 1);
+
+			while(!stop.load())
+			{
+				steady_clock::time_point begin = steady_clock::now();
+				chain.generateString(maxWordCount, random);
+				latencies[t].push_back(duration<double, micro>(steady_clock::now() - begin).count());
+			}
+		}));
+	}
+
+	for(unsigned int t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	vector<double> all;
+	for(int t = 0; t < threadCount; t++)
+		all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+
+	sort(all.begin(), all.end());
+	size_t count = all.size();
+
+	if(count > 0)
+	{
+		printf("%-24s p50 %8.2f us  p90 %8.2f us  p99 %8.2f us  p99.9 %8.2f us  max %8.2f us\n", label,
+			all[count * 50 / 100], all[count * 90 / 100], all[count * 99 / 100], all[count * 999 / 1000], all[count - 1]);
+	}
+
+	return count;
+}
+
+
+// Measures generation latency from a ConcurrentChain on its own, and then while another
+// thread adds a second corpus to it as fast as it can, publishing snapshots as it goes
+void benchOnline(int sentenceCount, int vocabularySize, double exponent)
+{
+	const int batchCount = 100;
+	const double idleSeconds = 1;
+
+	int readerCount = thread::hardware_concurrency() > 1 ? thread::hardware_concurrency() - 1 : 1;
+	printf("Online: %d sentences, then %d more in %d batches, %d readers\n", sentenceCount, sentenceCount, batchCount, readerCount);
+
+	ConcurrentChain chain;
+	chain.addText(makeZipfCorpus(sentenceCount, vocabularySize, exponent));
+	chain.publish();
+
+	vector<string> batches;
+	size_t size = 0;
+	for(int i = 0; i < batchCount; i++)
+	{
+		batches.push_back(makeZipfCorpus(sentenceCount / batchCount + 1, vocabularySize, exponent));
+		size += batches[i].length();
+	}
+
+	// About one snapshot for every 5 batches
+	chain.setPublishInterval(size / 20);
+
+	atomic<bool> stop(false);
+	thread timer([&stop, idleSeconds]()
+	{
+		this_thread::sleep_for(duration<double>(idleSeconds));
+		stop.store(true);
+	});
+
+	benchReaders(chain, "generate, idle", readerCount, stop);
+	timer.join();
+
+	unsigned long long firstVersion = chain.getVersion();
+	double seconds = 0;
+
+	stop.store(false);
+	thread writer([&chain, &batches, &stop, &seconds]()
+	{
+		steady_clock::time_point begin = steady_clock::now();
+
+		for(unsigned int i = 0; i < batches.size(); i++)
+			chain.addText(batches[i]);
+
+		seconds = duration<double>(steady_clock::now() - begin).count();
+		stop.store(true);
+	});
+
+	benchReaders(chain, "generate, training", readerCount, stop);
+	writer.join();
+
+	printf("%-24s %10d sentences %9.3f s %10.0f sentences/s %5llu snapshots\n", "addText, serving",
+		sentenceCount, seconds, sentenceCount / seconds, chain.getVersion() - firstVersion);
+}
+
+
+// Trains a chain and generates from it, then reports what its stats recorded: how training
+// time split between tokenizing and inserting, and the generation latency and length
+// percentiles from the histograms. Also times taking the stats and exporting them.
+void benchStats(int sentenceCount, int vocabularySize, int iterations, double exponent)
+{
+	printf("Stats: %d sentences, %d word vocabulary\n", sentenceCount, vocabularySize);
+
+	MarkovChain chain;
+	chain.setOrder(1);
+	chain.addText(makeZipfCorpus(sentenceCount, vocabularySize, exponent));
+
+	Random random(1);
+	for(int i = 0; i < iterations; i++)
+		chain.generateString(50, random);
+
+	steady_clock::time_point begin = steady_clock::now();
+	ChainStats stats = chain.getStats();
+	double seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10llu words %12llu links %9.6f s\n", "getStats", stats.words, stats.links, seconds);
+
+	begin = steady_clock::now();
+	string exported = stats.toPrometheus();
+	seconds = duration<double>(steady_clock::now() - begin).count();
+	printf("%-24s %10zu bytes %9.6f s\n", "toPrometheus", exported.length(), seconds);
+
+	if(!stats.recorded)
+	{
+		printf("%-24s built without MARQOV_STATS\n", "counters");
+		return;
+	}
+
+	printf("%-24s %10.3f s tokenizing %9.3f s inserting\n", "training time",
+		stats.counters[STAT_TOKENIZE_NANOSECONDS] / 1e9, stats.counters[STAT_INSERT_NANOSECONDS] / 1e9);
+	printf("%-24s %10llu at end %12llu at most words\n", "terminations",
+		stats.counters[STAT_END_REACHED], stats.counters[STAT_LENGTH_REACHED]);
+	printf("%-24s p50 <= %8.0f ns  p99 <= %8.0f ns\n", "latency histogram",
+		stats.getQuantile(STAT_LATENCY, 0.5), stats.getQuantile(STAT_LATENCY, 0.99));
+	printf("%-24s p50 <= %8.0f     p99 <= %8.0f\n", "length histogram",
+		stats.getQuantile(STAT_LENGTH, 0.5), stats.getQuantile(STAT_LENGTH, 0.99));
+	printf("%-24s p50 <= %8.0f     p99 <= %8.0f\n", "fan-out histogram",
+		stats.getQuantile(STAT_FANOUT, 0.5), stats.getQuantile(STAT_FANOUT, 0.99));
+}
+
+
+// Usage: marqov_bench [sentences] [vocabulary] [iterations] [Zipf exponent]
+int main(int argc, char** argv)
+{
+	int sentenceCount = argc > 1 ? atoi(argv[1]) : 20000;
+	int vocabularySize = argc > 2 ? atoi(argv[2]) : 20000;
+	int iterations = argc > 3 ? atoi(argv[3]) : 500;
+	double exponent = argc > 4 ? atof(argv[4]) : 1.0;
+
+	if(sentenceCount < 1 || vocabularySize < 1 || iterations < 1)
+	{
+		printf("Usage: %s [sentences] [vocabulary] [iterations] [Zipf exponent]\n", argv[0]);
+		return 1;
+	}
+
+	srand(1);
+
+	benchZipf(sentenceCount, vocabularySize, iterations, exponent);
+	benchCheckpoint(sentenceCount, vocabularySize, exponent);
+	benchPruning(sentenceCount, vocabularySize, exponent);
+	benchMerging(sentenceCount, vocabularySize, exponent);
+	benchSampling(sentenceCount, vocabularySize, iterations);
+	benchFrozen(sentenceCount, vocabularySize, iterations);
+	benchSeeding(sentenceCount, vocabularySize, iterations);
+	benchOrder(sentenceCount, vocabularySize, iterations);
+	benchTokenizer(sentenceCount, vocabularySize, iterations, exponent);
+	benchIngestion(sentenceCount, vocabularySize);
+	benchScoring(sentenceCount, vocabularySize, exponent);
+	benchConcurrency(sentenceCount, vocabularySize, iterations);
+	benchOnline(sentenceCount, vocabularySize, exponent);
+	benchBatching(sentenceCount, vocabularySize, iterations);
+	benchStats(sentenceCount, vocabularySize, iterations, exponent);
+
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * ChainShard.cpp: Definition of the ChainShard class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ChainShard.h"
+#include "MarkovChain.h"
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty shard containing only the start and end words. They have local
+// numbers but no text, since the chain supplies its own terminators when merging.
+ChainShard::ChainShard()
+{
+	occurrences.push_back(0);
+	occurrences.push_back(0);
+	recording = false;
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Sets the number of words in a run of words. It must be set before any sentence is added
+void ChainShard::setOrder(int order)
+{
+	postfixGrams.setOrder(order);
+	prefixGrams.setOrder(order);
+}
+
+
+// Counts the words of one tokenized sentence of the given number of words, in the same way
+// MarkovChain::addText does
+void ChainShard::addSentence(const string_view* sentence, unsigned int length)
+{
+	if(length == 0)
+		return;
+
+	// Start occurs artificially once per sentence, as in addText
+	int word = SHARD_START;
+	occurrences[word]++;
+	sentenceIndices.clear();
+
+	for(unsigned int i = 0; i < length; i++)
+	{
+		if(sentence[i].length() == 0)
+			continue;
+
+		int nextWord = getIndex(sentence[i]);
+		occurrences[nextWord]++;
+		sentenceIndices.push_back(nextWord);
+
+		if(recording)
+			sentences.push_back(nextWord);
+
+		addTransition(word, nextWord);
+
+		word = nextWord;
+	}
+
+	// Mark the last word as a possible end of a sentence
+	if(word != SHARD_START)
+	{
+		addTransition(word, SHARD_END);
+
+		if(recording)
+			sentences.push_back(SHARD_END);
+	}
+
+	// Count the runs of words as the chain does, using local numbers
+	if(postfixGrams.getOrder() > 1)
+	{
+		postfixGrams.addSentence(sentenceIndices, SHARD_START, SHARD_END, GENERATE_POSTFIX);
+		prefixGrams.addSentence(sentenceIndices, SHARD_START, SHARD_END, GENERATE_PREFIX);
+	}
+}
+
+
+// Counts one transition between the words with the given local numbers, numbering it if
+// it's new
+void ChainShard::addTransition(int word, int nextWord)
+{
+	unsigned long long key = ((unsigned long long)word << 32) | (unsigned int)nextWord;
+	auto found = transitionNumbers.emplace(key, (int)transitions.size());
+
+	if(found.second)
+	{
+		ShardTransition transition = {word, nextWord, 0};
+		transitions.push_back(transition);
+	}
+
+	transitions[found.first->second].count++;
+}
+
+
+// Returns the local number of the word with the given text, numbering it if it's new
+int ChainShard::getIndex(string_view text)
+{
+	int index = dictionary.intern(text) + SHARD_END + 1;
+
+	if(index == (int)occurrences.size())
+		occurrences.push_back(0);
+
+	return index;
+}
+
+
+// Returns the text of the word with the given local number. Start and end have none
+string_view ChainShard::getText(int index)
+{
+	if(index <= SHARD_END)
+		return string_view();
+
+	return dictionary.getText(index - SHARD_END - 1);
+}
@@ -0,0 +1,86 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * ChainShard.h: Declaration of the ChainShard class. Counts one share of a corpus for parallel training.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHAIN_SHARD_H
+#define CHAIN_SHARD_H
+
+#include "Dictionary.h"
+#include "NGramTable.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+// Local numbers of the start and end words in every shard
+#define SHARD_START 0
+#define SHARD_END 1
+
+// One transition from a word to the next, by local numbers, and the number of times it was seen
+struct ShardTransition
+{
+	int word;
+	int nextWord;
+	int count;
+};
+
+// The counts gathered from one contiguous share of a corpus, kept apart from any chain so
+// that several shards can be filled at once on different threads. Words are numbered
+// locally in the order they were first seen, and so are the transitions from one word to
+// the next. MarkovChain merges the shards back in corpus order, replaying each shard's words
+// and transitions in the order it first saw them, which creates new Words with the ids a
+// single-threaded addText would have given them. Links are sampled in order of those ids, so
+// the merged chain draws what one built by addText would.
+class ChainShard
+{
+public:
+	// The text of each word. A word's local number is its id here plus SHARD_END + 1
+	Dictionary dictionary;
+
+	// The number of occurrences of each word, indexed by local number
+	vector<int> occurrences;
+
+	// Every transition, numbered in the order it was first seen, and the number of each,
+	// keyed by the local number of the first word in the upper 32 bits and the second in
+	// the lower 32 bits
+	vector<ShardTransition> transitions;
+	unordered_map<unsigned long long, int> transitionNumbers;
+
+	// For an order above 1, the words seen after and before each run of words, by local number
+	NGramTable postfixGrams;
+	NGramTable prefixGrams;
+
+	// The local numbers of the sentence being added, reused by addSentence
+	vector<WordId> sentenceIndices;
+
+	// Whether to keep every sentence for the chain's checkpoint log, and the local numbers
+	// of the sentences kept, each followed by SHARD_END
+	bool recording;
+	vector<int> sentences;
+
+	ChainShard();
+
+	void setOrder(int);
+	void addSentence(const string_view*, unsigned int);
+	void addTransition(int, int);
+	int getIndex(string_view);
+	string_view getText(int);
+};
+
+#endif
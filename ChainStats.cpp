@@ -0,0 +1,220 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * ChainStats.cpp: Definition of the ChainStats class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ChainStats.h"
+#include <cstdio>
+#include <cstring>
+
+// The Prometheus name, help text and unit scale of each counter and histogram, by STAT_
+// number. Times are kept in nanoseconds and exported in seconds, as Prometheus expects.
+struct StatsMetric
+{
+	const char* name;
+	const char* help;
+	double scale;
+};
+
+static const StatsMetric counterMetrics[STAT_COUNTERS] =
+{
+	{"sentences_total", "Sentences added to the chain.", 1},
+	{"tokens_total", "Words added to the chain.", 1},
+	{"new_words_total", "Words added as text that the chain did not have before.", 1},
+	{"new_links_total", "Links from one word to the next the chain did not have before.", 1},
+	{"tokenize_seconds_total", "Time spent splitting added text into words.", 1e-9},
+	{"insert_seconds_total", "Time spent adding words and links to the chain.", 1e-9},
+	{"strings_total", "Strings generated.", 1},
+	{"steps_total", "Words chosen while generating.", 1},
+	{"end_reached_total", "Strings that ended by reaching the start and end of a sentence.", 1},
+	{"length_reached_total", "Strings that ended by reaching their most words.", 1}
+};
+
+static const StatsMetric histogramMetrics[STAT_HISTOGRAMS] =
+{
+	{"generate_seconds", "Time spent generating each string.", 1e-9},
+	{"string_words", "Words in each generated string.", 1},
+	{"fanout_links", "Links of each word a next word was chosen from.", 1}
+};
+
+
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
+
+
+// Writes a counted value in the given unit. Counts are written exactly, and times in seconds
+// to the nanosecond.
+string ChainStats::formatValue(unsigned long long value, double scale)
+{
+	char text[32];
+
+	if(scale == 1)
+		snprintf(text, sizeof(text), "%llu", value);
+	else
+		snprintf(text, sizeof(text), "%.9f", value * scale);
+
+	return text;
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes empty stats, with every counter, histogram and size at 0
+ChainStats::ChainStats()
+{
+	recorded = false;
+	memset(counters, 0, sizeof(counters));
+	memset(histograms, 0, sizeof(histograms));
+	words = 0;
+	links = 0;
+	textBytes = 0;
+	memoryBytes = 0;
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Returns the number of values counted by the given histogram
+unsigned long long ChainStats::getCount(int histogram) const
+{
+	unsigned long long count = 0;
+	for(int b = 0; b < STATS_BUCKETS; b++)
+		count += histograms[histogram].buckets[b];
+
+	return count;
+}
+
+
+// Returns the value the given fraction of the given histogram's values are no greater than.
+// Only the bucket is known, so the value is the largest its bucket could hold, which is at
+// most twice the true value. Returns 0 for an empty histogram.
+double ChainStats::getQuantile(int histogram, double fraction) const
+{
+	unsigned long long count = getCount(histogram);
+	if(count == 0)
+		return 0;
+
+	unsigned long long rank = (unsigned long long)(fraction * (count - 1)) + 1;
+	unsigned long long seen = 0;
+
+	for(int b = 0; b < STATS_BUCKETS; b++)
+	{
+		seen += histograms[histogram].buckets[b];
+		if(seen >= rank)
+			return (double)((1ULL << b) - 1);
+	}
+
+	return (double)((1ULL << (STATS_BUCKETS - 1)) - 1);
+}
+
+
+// Returns the stats in the Prometheus text exposition format, with every name beginning
+// "marqov_"
+string ChainStats::toPrometheus() const
+{
+	return toPrometheus("marqov");
+}
+
+
+// Returns the stats in the Prometheus text exposition format, with every name beginning with
+// the given prefix and an underscore. Counters and histograms are left out if they weren't
+// recorded, so that a scrape can't mistake them for a chain that has done nothing.
+string ChainStats::toPrometheus(string prefix) const
+{
+	string text;
+	char line[512];
+
+	const char* gaugeNames[4] = {"words", "links", "text_bytes", "memory_bytes"};
+	const char* gaugeHelp[4] = {"Words in the chain.", "Links from one word to the next.",
+		"Bytes of word text.", "Bytes held by the chain."};
+	unsigned long long gauges[4] = {words, links, textBytes, memoryBytes};
+
+	for(int i = 0; i < 4; i++)
+	{
+		snprintf(line, sizeof(line), "# HELP %s_%s %s\n# TYPE %s_%s gauge\n%s_%s %llu\n",
+			prefix.c_str(), gaugeNames[i], gaugeHelp[i], prefix.c_str(), gaugeNames[i],
+			prefix.c_str(), gaugeNames[i], gauges[i]);
+		text.append(line);
+	}
+
+	if(!recorded)
+		return text;
+
+	for(int i = 0; i < STAT_COUNTERS; i++)
+	{
+		const StatsMetric& metric = counterMetrics[i];
+
+		snprintf(line, sizeof(line), "# HELP %s_%s %s\n# TYPE %s_%s counter\n%s_%s ",
+			prefix.c_str(), metric.name, metric.help, prefix.c_str(), metric.name,
+			prefix.c_str(), metric.name);
+		text.append(line);
+		text.append(formatValue(counters[i], metric.scale));
+		text.append("\n");
+	}
+
+	// Prometheus buckets count every value up to their bound, so they are running totals
+	for(int i = 0; i < STAT_HISTOGRAMS; i++)
+	{
+		const StatsMetric& metric = histogramMetrics[i];
+
+		snprintf(line, sizeof(line), "# HELP %s_%s %s\n# TYPE %s_%s histogram\n",
+			prefix.c_str(), metric.name, metric.help, prefix.c_str(), metric.name);
+		text.append(line);
+
+		unsigned long long count = 0;
+		for(int b = 0; b < STATS_BUCKETS - 1; b++)
+		{
+			count += histograms[i].buckets[b];
+
+			snprintf(line, sizeof(line), "%s_%s_bucket{le=\"%s\"} %llu\n", prefix.c_str(), metric.name,
+				formatValue((1ULL << b) - 1, metric.scale).c_str(), count);
+			text.append(line);
+		}
+
+		count += histograms[i].buckets[STATS_BUCKETS - 1];
+
+		snprintf(line, sizeof(line), "%s_%s_bucket{le=\"+Inf\"} %llu\n%s_%s_sum %s\n%s_%s_count %llu\n",
+			prefix.c_str(), metric.name, count, prefix.c_str(), metric.name,
+			formatValue(histograms[i].sum, metric.scale).c_str(), prefix.c_str(), metric.name, count);
+		text.append(line);
+	}
+
+	return text;
+}
+
+
+// Returns the bucket that counts the given value, the number of bits needed to write it
+int ChainStats::getBucket(unsigned long long value)
+{
+	int bucket;
+
+#ifdef __GNUC__
+	bucket = (value == 0) ? 0 : 64 - __builtin_clzll(value);
+#else
+	for(bucket = 0; value > 0; bucket++)
+		value >>= 1;
+#endif
+
+	return (bucket < STATS_BUCKETS) ? bucket : STATS_BUCKETS - 1;
+}
@@ -0,0 +1,100 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * ChainStats.h: Declaration of the ChainStats class. A snapshot of what a chain holds and has done.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHAIN_STATS_H
+#define CHAIN_STATS_H
+
+#include <string>
+
+using namespace std;
+
+// The counters of ingestion. Sentences and words added, words and postfix links the chain
+// didn't have before, and the nanoseconds spent splitting text into words and adding them.
+// Only text counts, so the words and links a chain rebuilds from an image when it loads,
+// merges or prunes don't.
+#define STAT_SENTENCES 0
+#define STAT_TOKENS 1
+#define STAT_NEW_WORDS 2
+#define STAT_NEW_LINKS 3
+#define STAT_TOKENIZE_NANOSECONDS 4
+#define STAT_INSERT_NANOSECONDS 5
+
+// The counters of generation. Strings generated, words chosen, and the strings that ended by
+// reaching both terminators or by reaching their most words
+#define STAT_STRINGS 6
+#define STAT_STEPS 7
+#define STAT_END_REACHED 8
+#define STAT_LENGTH_REACHED 9
+
+#define STAT_COUNTERS 10
+
+// The histograms of generation. Nanoseconds to generate each string, words in each string,
+// and the number of links of each word a next word was chosen from
+#define STAT_LATENCY 0
+#define STAT_LENGTH 1
+#define STAT_FANOUT 2
+
+#define STAT_HISTOGRAMS 3
+
+// Histogram bucket b counts the values less than 2 to the b that no lower bucket counts, so
+// bucket 0 counts only 0. The last bucket also counts everything larger.
+#define STATS_BUCKETS 32
+
+// The counts of values in each bucket of a histogram, and the sum of the values
+struct StatsHistogram
+{
+	unsigned long long buckets[STATS_BUCKETS];
+	unsigned long long sum;
+};
+
+// The statistics of a MarkovChain at one moment, as returned by MarkovChain::getStats. The
+// counters and histograms run from when the chain was made or its stats were last reset. They
+// are only kept when the library is built with MARQOV_STATS, and are all 0 otherwise, which
+// recorded tells apart from a chain that hasn't done anything. The sizes are always filled in.
+class ChainStats
+{
+private:
+	static string formatValue(unsigned long long, double);
+
+public:
+	// Whether the counters and histograms were kept
+	bool recorded;
+
+	// The counters by STAT_ number, and the histograms by STAT_ number
+	unsigned long long counters[STAT_COUNTERS];
+	StatsHistogram histograms[STAT_HISTOGRAMS];
+
+	// The number of words, the number of links from one word to the next, the bytes of word
+	// text, and the bytes getMemoryUsage counts
+	unsigned long long words;
+	unsigned long long links;
+	unsigned long long textBytes;
+	unsigned long long memoryBytes;
+
+	ChainStats();
+
+	unsigned long long getCount(int) const;
+	double getQuantile(int, double) const;
+	string toPrometheus() const;
+	string toPrometheus(string) const;
+
+	static int getBucket(unsigned long long);
+};
+
+#endif
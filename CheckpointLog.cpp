@@ -0,0 +1,226 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * CheckpointLog.cpp: Definition of the CheckpointLog class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CheckpointLog.h"
+#include "FrozenChain.h"
+#include <fstream>
+#include <cstring>
+
+// Identify log files and their records
+static const char logMagic[4] = {'M', 'Q', 'L', 'G'};
+static const char recordMagic[4] = {'M', 'Q', 'L', 'R'};
+
+// Rounds a size up to a multiple of 4, which the checksum works in
+static size_t padded(size_t size)
+{
+	return (size + 3) & ~(size_t)3;
+}
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes a log with nothing to read
+CheckpointLog::CheckpointLog()
+{
+	position = 0;
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Replaces the given file with an empty log following the snapshot with the given checksum.
+// Returns false if the file could not be written.
+bool CheckpointLog::create(string fileName, unsigned int snapshotChecksum)
+{
+	LogHeader header;
+	memcpy(header.magic, logMagic, sizeof(header.magic));
+	header.version = LOG_VERSION;
+	header.snapshotChecksum = snapshotChecksum;
+	header.reserved = 0;
+
+	ofstream logFile(fileName.c_str(), ios::out | ios::trunc | ios::binary);
+	if(!logFile.is_open())
+		return false;
+
+	logFile.write((const char*)&header, sizeof(header));
+	logFile.close();
+
+	return !logFile.fail();
+}
+
+
+// Appends a record to the given log. Words holds the text of each word the record refers
+// to, and numbers the sentences as indices into words, each followed by LOG_SENTENCE_END.
+// Returns the number of bytes appended, or 0 if the file could not be written.
+size_t CheckpointLog::append(string fileName, const vector<string_view>& words, const vector<unsigned int>& numbers)
+{
+	size_t textSize = 0;
+	for(unsigned int i = 0; i < words.size(); i++)
+		textSize += words[i].length();
+
+	size_t lengthsSize = words.size() * sizeof(unsigned int);
+	size_t numbersSize = numbers.size() * sizeof(unsigned int);
+	size_t size = sizeof(LogRecord) + lengthsSize + padded(textSize) + numbersSize;
+
+	// Lay the record out in one block so that it's checksummed and written at once
+	record.assign(size, 0);
+	char* body = &record[0] + sizeof(LogRecord);
+
+	unsigned int* lengths = (unsigned int*)body;
+	char* text = body + lengthsSize;
+
+	for(unsigned int i = 0; i < words.size(); i++)
+	{
+		lengths[i] = words[i].length();
+		memcpy(text, words[i].data(), words[i].length());
+		text += words[i].length();
+	}
+
+	if(numbersSize > 0)
+		memcpy(body + lengthsSize + padded(textSize), &numbers[0], numbersSize);
+
+	LogRecord* header = (LogRecord*)&record[0];
+	memcpy(header->magic, recordMagic, sizeof(header->magic));
+	header->wordCount = words.size();
+	header->textSize = textSize;
+	header->numberCount = numbers.size();
+	header->checksum = FrozenChain::checksum(body, size - sizeof(LogRecord));
+
+	ofstream logFile(fileName.c_str(), ios::out | ios::app | ios::binary);
+	if(!logFile.is_open())
+		return 0;
+
+	logFile.write(&record[0], size);
+	logFile.close();
+
+	return logFile.fail() ? 0 : size;
+}
+
+
+// Reads the given log to replay its records. Returns false if the file is missing, is not a
+// log or follows a snapshot other than the one with the given checksum.
+bool CheckpointLog::open(string fileName, unsigned int snapshotChecksum)
+{
+	contents.clear();
+	position = 0;
+
+	ifstream logFile(fileName.c_str(), ios::in | ios::binary);
+	if(!logFile.is_open())
+		return false;
+
+	logFile.seekg(0, ios::end);
+	size_t size = (size_t)logFile.tellg();
+	logFile.seekg(0, ios::beg);
+
+	if(size < sizeof(LogHeader))
+		return false;
+
+	contents.resize(size);
+	if(!logFile.read(&contents[0], size))
+		return false;
+
+	const LogHeader* header = (const LogHeader*)&contents[0];
+	if(memcmp(header->magic, logMagic, sizeof(header->magic)) != 0 || header->version != LOG_VERSION)
+		return false;
+
+	if(header->snapshotChecksum != snapshotChecksum)
+		return false;
+
+	position = sizeof(LogHeader);
+	return true;
+}
+
+
+// Reads the next record of the open log into words and numbers, laid out as append takes
+// them. The words refer to the log, which must stay open while they're used. Returns false
+// at the end of the log or at the first record that is incomplete or damaged.
+bool CheckpointLog::readRecord(vector<string_view>& words, vector<unsigned int>& numbers)
+{
+	words.clear();
+	numbers.clear();
+
+	if(contents.size() - position < sizeof(LogRecord))
+		return false;
+
+	LogRecord header;
+	memcpy(&header, &contents[position], sizeof(header));
+
+	if(memcmp(header.magic, recordMagic, sizeof(header.magic)) != 0)
+		return false;
+
+	// The counts are 32 bits, so the sizes can't overflow
+	size_t lengthsSize = (size_t)header.wordCount * sizeof(unsigned int);
+	size_t numbersSize = (size_t)header.numberCount * sizeof(unsigned int);
+	size_t bodySize = lengthsSize + padded(header.textSize) + numbersSize;
+
+	if(contents.size() - position - sizeof(LogRecord) < bodySize)
+		return false;
+
+	const char* body = &contents[position] + sizeof(LogRecord);
+	if(FrozenChain::checksum(body, bodySize) != header.checksum)
+		return false;
+
+	const unsigned int* lengths = (const unsigned int*)body;
+	const char* text = body + lengthsSize;
+	const unsigned int* recordNumbers = (const unsigned int*)(text + padded(header.textSize));
+
+	size_t offset = 0;
+	for(unsigned int i = 0; i < header.wordCount; i++)
+	{
+		if(lengths[i] > header.textSize - offset)
+			return false;
+
+		words.push_back(string_view(text + offset, lengths[i]));
+		offset += lengths[i];
+	}
+
+	// Every number must name a word of the record, and the last sentence must be ended
+	for(unsigned int i = 0; i < header.numberCount; i++)
+	{
+		if(recordNumbers[i] >= header.wordCount && recordNumbers[i] != LOG_SENTENCE_END)
+			return false;
+	}
+
+	if(header.numberCount > 0 && recordNumbers[header.numberCount - 1] != LOG_SENTENCE_END)
+		return false;
+
+	numbers.assign(recordNumbers, recordNumbers + header.numberCount);
+	position += sizeof(LogRecord) + bodySize;
+
+	return true;
+}
+
+
+// Returns the number of bytes of the open log up to the end of the last record read
+size_t CheckpointLog::getSize() const
+{
+	return position;
+}
+
+
+// Returns true if every byte of the open log belonged to a record that was read
+bool CheckpointLog::isFinished() const
+{
+	return position == contents.size();
+}
@@ -0,0 +1,91 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * CheckpointLog.h: Declaration of the CheckpointLog class. Appends the sentences added to a chain to a log.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_LOG_H
+#define CHECKPOINT_LOG_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// The version of the log layout written by CheckpointLog
+#define LOG_VERSION 1
+
+// Appended to the name of a chain file to name its log
+#define LOG_SUFFIX ".log"
+
+// Ends each sentence in the word numbers of a log record
+#define LOG_SENTENCE_END 0xFFFFFFFFu
+
+// The start of a log file. The log only applies to the chain image with this checksum
+struct LogHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned int snapshotChecksum;
+	unsigned int reserved;
+};
+
+// The start of each record of a log. It's followed by the length of each of its words, their
+// text back to back, padded to a multiple of 4 bytes, and then the sentences as numbers of
+// those words, each sentence followed by LOG_SENTENCE_END.
+struct LogRecord
+{
+	char magic[4];
+	unsigned int wordCount;
+	unsigned int textSize;
+	unsigned int numberCount;
+
+	// Checksum of everything in the record after this header
+	unsigned int checksum;
+};
+
+// A write-ahead log of the sentences added to a chain since its last snapshot. Each checkpoint
+// appends one record holding only the new sentences and the text of the words in them, so
+// writing one costs as much as the text it records, however large the chain is. Loading the
+// snapshot and then adding the sentences of each record in turn rebuilds the chain.
+//
+// Records are appended whole, so a record cut short by a crash fails its checksum and it and
+// anything after it are ignored. A log names the checksum of the snapshot it follows, so a log
+// left over from an older snapshot is never applied to a newer one.
+class CheckpointLog
+{
+private:
+	// The whole log when it's being read, and the offset of the next record
+	vector<char> contents;
+	size_t position;
+
+	// The record being written, reused from one append to the next
+	vector<char> record;
+
+public:
+	CheckpointLog();
+
+	static bool create(string, unsigned int);
+	size_t append(string, const vector<string_view>&, const vector<unsigned int>&);
+
+	bool open(string, unsigned int);
+	bool readRecord(vector<string_view>&, vector<unsigned int>&);
+	size_t getSize() const;
+	bool isFinished() const;
+};
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * ConcurrentChain.cpp: Definition of the ConcurrentChain class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ConcurrentChain.h"
+#include <functional>
+#include <thread>
+
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
+
+
+// Claims a reader slot for the calling thread, marks it with the current epoch and returns
+// the snapshot to generate from. Each thread starts looking at a slot of its own, so threads
+// only contend for one when there are more of them than slots.
+//
+// Every atomic operation here and in publishSnapshot is sequentially consistent. A reader
+// that finds the epoch a publish advanced to therefore also finds the snapshot it published,
+// and a publish that finds a slot idle is ordered before the reader that claims it.
+const FrozenChain* ConcurrentChain::enter(unsigned int& slot) const
+{
+	size_t first = hash<thread::id>()(this_thread::get_id());
+
+	for(size_t i = 0;; i++)
+	{
+		slot = (first + i) % CONCURRENT_READER_SLOTS;
+
+		unsigned long long idle = CONCURRENT_IDLE;
+		if(slots[slot].epoch.compare_exchange_strong(idle, epoch.load()))
+			return current.load();
+
+		// Every slot is taken, so let another thread finish
+		if(i % CONCURRENT_READER_SLOTS == CONCURRENT_READER_SLOTS - 1)
+			this_thread::yield();
+	}
+}
+
+
+// Gives up a slot claimed by enter, after which the snapshot read through it may be freed
+void ConcurrentChain::leave(unsigned int slot) const
+{
+	slots[slot].epoch.store(CONCURRENT_IDLE);
+}
+
+
+// Freezes the chain and swaps the snapshot in for readers. The writer lock must be held.
+void ConcurrentChain::publishSnapshot()
+{
+	const FrozenChain* snapshot = new FrozenChain(chain, edgeFormat);
+	const FrozenChain* replaced = current.exchange(snapshot);
+
+	// Readers that enter after this find the new snapshot, so the replaced one is only in use
+	// by readers holding this epoch or an earlier one
+	unsigned long long lastEpoch = epoch.fetch_add(1);
+
+	if(replaced != NULL)
+		retired.push_back(make_pair(replaced, lastEpoch));
+
+	unpublished = 0;
+	reclaim();
+}
+
+
+// Frees the replaced snapshots no reader can still be using. The writer lock must be held.
+void ConcurrentChain::reclaim()
+{
+	unsigned long long oldest = ~0ULL;
+	for(int i = 0; i < CONCURRENT_READER_SLOTS; i++)
+	{
+		unsigned long long slotEpoch = slots[i].epoch.load();
+		if(slotEpoch != CONCURRENT_IDLE && slotEpoch < oldest)
+			oldest = slotEpoch;
+	}
+
+	unsigned int kept = 0;
+	for(unsigned int i = 0; i < retired.size(); i++)
+	{
+		if(retired[i].second < oldest)
+			delete retired[i].first;
+		else
+			retired[kept++] = retired[i];
+	}
+
+	retired.resize(kept);
+}
+
+
+// Counts text added to the chain and publishes a snapshot once enough of it has been. The
+// writer lock must be held.
+void ConcurrentChain::textAdded(size_t size)
+{
+	unpublished += size;
+
+	if(publishInterval > 0 && unpublished >= publishInterval)
+		publishSnapshot();
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty chain and publishes it, so readers always have a snapshot
+ConcurrentChain::ConcurrentChain()
+{
+	current.store(NULL);
+	epoch.store(CONCURRENT_IDLE + 1);
+
+	for(int i = 0; i < CONCURRENT_READER_SLOTS; i++)
+		slots[i].epoch.store(CONCURRENT_IDLE);
+
+	edgeFormat = FROZEN_EDGES_PLAIN;
+	unpublished = 0;
+	publishInterval = CONCURRENT_PUBLISH_INTERVAL;
+
+	publishSnapshot();
+}
+
+
+// Frees every snapshot. No thread may be generating from the chain.
+ConcurrentChain::~ConcurrentChain()
+{
+	for(unsigned int i = 0; i < retired.size(); i++)
+		delete retired[i].first;
+
+	delete current.load();
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Adds the text to the chain as MarkovChain::addText does. Readers see it once the next
+// snapshot is published. Writers take turns, but never wait for readers.
+void ConcurrentChain::addText(string text)
+{
+	lock_guard<mutex> lock(writerLock);
+
+	chain.addText(text);
+	textAdded(text.length());
+}
+
+
+// Adds the texts to the chain on the given number of threads, as MarkovChain::addTexts does
+void ConcurrentChain::addTexts(vector<string> texts, int threadCount)
+{
+	size_t size = 0;
+	for(unsigned int i = 0; i < texts.size(); i++)
+		size += texts[i].length();
+
+	lock_guard<mutex> lock(writerLock);
+
+	chain.addTexts(texts, threadCount);
+	textAdded(size);
+}
+
+
+// Publishes a snapshot of everything added so far, without waiting for the publish interval
+void ConcurrentChain::publish()
+{
+	lock_guard<mutex> lock(writerLock);
+
+	publishSnapshot();
+}
+
+
+// Replaces the chain with the one in the given file, as MarkovChain::load does, and
+// publishes it. Returns false if the file can't be read, leaving the chain as it was and
+// publishing nothing, so text added since the last publish stays unpublished.
+bool ConcurrentChain::load(string fileName)
+{
+	lock_guard<mutex> lock(writerLock);
+
+	if(!chain.load(fileName))
+		return false;
+
+	publishSnapshot();
+	return true;
+}
+
+
+// Saves the chain, including text not yet published, as MarkovChain::save does
+void ConcurrentChain::save(string fileName)
+{
+	lock_guard<mutex> lock(writerLock);
+
+	chain.save(fileName);
+}
+
+
+// Generates a semi-random sentence around a random word of the seed using the calling
+// thread's random engine
+string ConcurrentChain::generateString(string seed, int maxWordCount) const
+{
+	return generateString(seed, maxWordCount, Random::local());
+}
+
+
+// Generates a semi-random sentence around a random word of the seed from the latest snapshot
+string ConcurrentChain::generateString(string seed, int maxWordCount, Random& random) const
+{
+	unsigned int slot;
+	const FrozenChain* snapshot = enter(slot);
+
+	string generated = snapshot->generateString(seed, maxWordCount, random);
+
+	leave(slot);
+	return generated;
+}
+
+
+// Generates a semi-random sentence beginning with the start word using the calling
+// thread's random engine
+string ConcurrentChain::generateString(int maxWordCount) const
+{
+	return generateString(maxWordCount, Random::local());
+}
+
+
+// Generates a semi-random sentence beginning with the start word from the latest snapshot
+string ConcurrentChain::generateString(int maxWordCount, Random& random) const
+{
+	unsigned int slot;
+	const FrozenChain* snapshot = enter(slot);
+
+	string generated = snapshot->generateString(maxWordCount, random);
+
+	leave(slot);
+	return generated;
+}
+
+
+// Generates the given number of sentences into the buffer using the calling thread's
+// random engine
+void ConcurrentChain::generateBatch(int count, int maxWordCount, GenerationBuffer& buffer) const
+{
+	generateBatch(count, maxWordCount, buffer, Random::local());
+}
+
+
+// Generates the given number of sentences into the buffer, all from the same snapshot
+void ConcurrentChain::generateBatch(int count, int maxWordCount, GenerationBuffer& buffer, Random& random) const
+{
+	unsigned int slot;
+	const FrozenChain* snapshot = enter(slot);
+
+	snapshot->generateBatch(count, maxWordCount, buffer, random);
+
+	leave(slot);
+}
+
+
+// Sets the order of the chain, as MarkovChain::setOrder does, and publishes the result
+void ConcurrentChain::setOrder(int order)
+{
+	lock_guard<mutex> lock(writerLock);
+
+	chain.setOrder(order);
+	publishSnapshot();
+}
+
+
+// Sets the format of the links of later snapshots, FROZEN_EDGES_PLAIN or FROZEN_EDGES_PACKED
+void ConcurrentChain::setEdgeFormat(int format)
+{
+	lock_guard<mutex> lock(writerLock);
+
+	edgeFormat = format;
+}
+
+
+// Sets how many bytes of text are added between snapshots. Freezing takes time in proportion
+// to the whole chain, so a larger interval spends less of the writers' time on it, and readers
+// see new text later. 0 publishes only when publish is called.
+void ConcurrentChain::setPublishInterval(size_t bytes)
+{
+	lock_guard<mutex> lock(writerLock);
+
+	publishInterval = bytes;
+}
+
+
+// Returns the number of snapshots published so far, the first being the empty chain
+unsigned long long ConcurrentChain::getVersion() const
+{
+	return epoch.load() - (CONCURRENT_IDLE + 1);
+}
+
+
+// Returns the number of replaced snapshots that readers may still be using
+size_t ConcurrentChain::getRetiredCount()
+{
+	lock_guard<mutex> lock(writerLock);
+
+	return retired.size();
+}
@@ -0,0 +1,118 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * ConcurrentChain.h: Declaration of the ConcurrentChain class. Generates from a chain while text is added to it.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONCURRENT_CHAIN_H
+#define CONCURRENT_CHAIN_H
+
+#include "MarkovChain.h"
+#include "FrozenChain.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// The number of threads that can be generating at the same moment without waiting for
+// one another to finish. More threads may generate, but they take turns with a slot.
+#define CONCURRENT_READER_SLOTS 64
+
+// Held by a reader slot when no thread is generating with it
+#define CONCURRENT_IDLE 0
+
+// The bytes of text added between snapshots unless told otherwise
+#define CONCURRENT_PUBLISH_INTERVAL (4 * 1048576)
+
+// A slot a generating thread announces the epoch it entered in, alone on its cache line so
+// that threads entering different slots don't slow each other down
+struct alignas(64) ReaderSlot
+{
+	atomic<unsigned long long> epoch;
+};
+
+// A MarkovChain that any number of threads can generate from while text is being added to
+// it. Text goes into a MarkovChain that only writers touch, one at a time. Every so often
+// the writer freezes it and publishes the snapshot by swapping a pointer, and generation
+// always runs against a whole snapshot, so readers see each version complete or not at all
+// and never take a lock.
+//
+// Old snapshots are reclaimed by epoch. A reader marks a slot with the current epoch before
+// it reads the snapshot pointer and clears it when it's done. Publishing advances the epoch,
+// and a replaced snapshot is freed once no slot holds an epoch from before its replacement.
+class ConcurrentChain
+{
+private:
+	// The chain text is added to, and the lock writers hold while they change or freeze it
+	MarkovChain chain;
+	mutex writerLock;
+
+	// The snapshot readers generate from
+	atomic<const FrozenChain*> current;
+
+	// The epoch and the slots readers announce themselves in
+	atomic<unsigned long long> epoch;
+	mutable ReaderSlot slots[CONCURRENT_READER_SLOTS];
+
+	// Replaced snapshots, each with the last epoch a reader could have found it in
+	vector<pair<const FrozenChain*, unsigned long long> > retired;
+
+	// The format of the snapshots' links
+	int edgeFormat;
+
+	// Bytes of text added since the last snapshot, and how many to add before the next
+	size_t unpublished;
+	size_t publishInterval;
+
+	const FrozenChain* enter(unsigned int&) const;
+	void leave(unsigned int) const;
+	void publishSnapshot();
+	void reclaim();
+	void textAdded(size_t);
+
+	// Readers hold pointers into the chain, so it stays put
+	ConcurrentChain(const ConcurrentChain&);
+	ConcurrentChain& operator=(const ConcurrentChain&);
+
+public:
+	ConcurrentChain();
+	~ConcurrentChain();
+
+	void addText(string);
+	void addTexts(vector<string>, int);
+	void publish();
+
+	bool load(string);
+	void save(string);
+
+	string generateString(string, int) const;
+	string generateString(string, int, Random&) const;
+	string generateString(int) const;
+	string generateString(int, Random&) const;
+	void generateBatch(int, int, GenerationBuffer&) const;
+	void generateBatch(int, int, GenerationBuffer&, Random&) const;
+
+	void setOrder(int);
+	void setEdgeFormat(int);
+	void setPublishInterval(size_t);
+
+	unsigned long long getVersion() const;
+	size_t getRetiredCount();
+};
+
+#endif
@@ -0,0 +1,329 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * CumulativeTable.cpp: Definition of the CumulativeTable class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CumulativeTable.h"
+#include "MarkovChain.h"
+#include <algorithm>
+
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
+
+
+// Adds a position at the end of the tree holding the given id and count. A new node covers
+// the nodes just below it, so its sum is gathered from them rather than starting at its count.
+void CumulativeTable::append(WordId id, int count)
+{
+	int node = tree.size() + 1;
+	int sum = count;
+
+	for(int covered = 1; covered < (node & -node); covered <<= 1)
+		sum += tree[node - covered - 1];
+
+	ids.push_back(id);
+	tree.push_back(sum);
+}
+
+
+// Adds the given count to a word that isn't in the tree and would go before its end, adding
+// the word to the waiting words if it isn't among them. Once too many words are waiting,
+// they are merged into the tree.
+void CumulativeTable::addPending(WordId id, int count)
+{
+	auto position = lower_bound(pendingIds.begin(), pendingIds.end(), id);
+	unsigned int index = position - pendingIds.begin();
+
+	if(position == pendingIds.end() || *position != id)
+	{
+		pendingIds.insert(position, id);
+		pendingTotals.insert(pendingTotals.begin() + index, (index == 0) ? 0 : pendingTotals[index - 1]);
+	}
+
+	// The running totals from this word on all include its count
+	for(unsigned int i = index; i < pendingTotals.size(); i++)
+		pendingTotals[i] += count;
+
+	if(pendingIds.size() > CUMULATIVE_MAX_PENDING)
+		merge();
+}
+
+
+// Merges the waiting words into the tree. The tree is taken back apart into counts, the two
+// lists of words are merged in order of id, and the tree is summed again, all in one pass each.
+void CumulativeTable::merge()
+{
+	// Undo sum, each node taking its sum back out of its parent before the parent's own is
+	for(int node = tree.size(); node >= 1; node--)
+	{
+		int parent = node + (node & -node);
+		if(parent <= (int)tree.size())
+			tree[parent - 1] -= tree[node - 1];
+	}
+
+	vector<WordId> mergedIds;
+	vector<int> counts;
+	mergedIds.reserve(ids.size() + pendingIds.size());
+	counts.reserve(ids.size() + pendingIds.size());
+
+	unsigned int i = 0;
+	unsigned int j = 0;
+
+	while(i < ids.size() || j < pendingIds.size())
+	{
+		if(j == pendingIds.size() || (i < ids.size() && ids[i] < pendingIds[j]))
+		{
+			mergedIds.push_back(ids[i]);
+			counts.push_back(tree[i]);
+			i++;
+		}
+		else
+		{
+			mergedIds.push_back(pendingIds[j]);
+			counts.push_back(pendingTotals[j] - ((j == 0) ? 0 : pendingTotals[j - 1]));
+			j++;
+		}
+	}
+
+	ids.swap(mergedIds);
+	tree.swap(counts);
+	pendingIds.clear();
+	pendingTotals.clear();
+
+	sum();
+}
+
+
+// Turns a tree holding the count of each position into running totals. Each node passes its
+// sum up to its parent, which builds the tree in a single pass.
+void CumulativeTable::sum()
+{
+	int size = tree.size();
+
+	for(int node = 1; node <= size; node++)
+	{
+		int parent = node + (node & -node);
+		if(parent <= size)
+			tree[parent - 1] += tree[node - 1];
+	}
+}
+
+
+// Returns the sum of the counts of the given number of positions at the start of the tree
+int CumulativeTable::getPrefix(int positions) const
+{
+	int sum = 0;
+	for(int node = positions; node > 0; node -= node & -node)
+		sum += tree[node - 1];
+
+	return sum;
+}
+
+
+// Returns the sum of the counts of the waiting words with lower ids than the given one
+int CumulativeTable::getPendingBefore(WordId id) const
+{
+	unsigned int before = lower_bound(pendingIds.begin(), pendingIds.end(), id) - pendingIds.begin();
+	return (before == 0) ? 0 : pendingTotals[before - 1];
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty table. Sampling an empty table returns NO_WORD
+CumulativeTable::CumulativeTable()
+{
+	total = 0;
+}
+
+
+// Initializes the table from the given links, using the counts of the given direction
+CumulativeTable::CumulativeTable(const WordLinks& links, int direction)
+{
+	total = 0;
+	build(links, direction);
+}
+
+
+// Initializes the table from the given words of a context
+CumulativeTable::CumulativeTable(const vector<NGramEdge>& edges)
+{
+	total = 0;
+	build(edges);
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Builds the table from the links' counts in the given direction, GENERATE_PREFIX or
+// GENERATE_POSTFIX. Links without a count in that direction are left out. The links are
+// kept in order of id, so they go into the tree as they are.
+void CumulativeTable::build(const WordLinks& links, int direction)
+{
+	ids.clear();
+	tree.clear();
+	pendingIds.clear();
+	pendingTotals.clear();
+	total = 0;
+
+	for(auto i = links.begin(); i != links.end(); i++)
+	{
+		int count = (direction == GENERATE_PREFIX) ? i->second.prefixOccurrences : i->second.postfixOccurrences;
+		if(count <= 0)
+			continue;
+
+		ids.push_back(i->first);
+		tree.push_back(count);
+		total += count;
+	}
+
+	sum();
+}
+
+
+// Builds the table from the words of a context, which may be in any order
+void CumulativeTable::build(const vector<NGramEdge>& edges)
+{
+	vector<NGramEdge> sorted(edges);
+	sort(sorted.begin(), sorted.end(), [](const NGramEdge& a, const NGramEdge& b)
+	{
+		return a.word < b.word;
+	});
+
+	ids.clear();
+	tree.clear();
+	pendingIds.clear();
+	pendingTotals.clear();
+	total = 0;
+
+	for(unsigned int i = 0; i < sorted.size(); i++)
+	{
+		ids.push_back(sorted[i].word);
+		tree.push_back(sorted[i].count);
+		total += sorted[i].count;
+	}
+
+	sum();
+}
+
+
+// Adds the given count, which may be negative, to the word with the given id, adding the word
+// if it isn't in the table. A word already in the tree costs a walk up it, and a word with a
+// higher id than any in the tree extends it. Any other word waits to be merged into it.
+void CumulativeTable::add(WordId id, int count)
+{
+	total += count;
+
+	if(ids.empty() || id > ids.back())
+	{
+		append(id, count);
+		return;
+	}
+
+	auto position = lower_bound(ids.begin(), ids.end(), id);
+	if(*position != id)
+	{
+		addPending(id, count);
+		return;
+	}
+
+	for(int node = position - ids.begin() + 1; node <= (int)tree.size(); node += node & -node)
+		tree[node - 1] += count;
+}
+
+
+// Chooses the id of a random word, weighted by its count, or returns NO_WORD if the table has
+// no counts. The chosen word is the first, in order of id, whose running total passes a random
+// value below the total. The tree is searched from the top, keeping the part of the value left
+// past each node it skips, until it reaches that word. Words waiting beside the tree add their
+// counts to the running totals of the words after them, and may be the word chosen. The table
+// isn't changed, so any number of threads may share it.
+WordId CumulativeTable::sample(Random& random) const
+{
+	if(total <= 0)
+		return NO_WORD;
+
+	int r = random.nextInt(total);
+	int size = tree.size();
+
+	int step = 1;
+	while(step * 2 <= size)
+		step *= 2;
+
+	int node = 0;
+	int passed = 0;
+
+	if(pendingIds.empty())
+	{
+		for(; step > 0; step >>= 1)
+		{
+			if(node + step <= size && tree[node + step - 1] <= r)
+			{
+				node += step;
+				r -= tree[node - 1];
+			}
+		}
+
+		return ids[node];
+	}
+
+	// Find the first word of the tree whose running total, with the waiting words before it, passes r
+	for(; step > 0; step >>= 1)
+	{
+		int next = node + step;
+		if(next <= size && passed + tree[next - 1] + getPendingBefore(ids[next - 1]) <= r)
+		{
+			node = next;
+			passed += tree[next - 1];
+		}
+	}
+
+	// Find the first waiting word whose running total, with the words of the tree before it, passes r
+	unsigned int low = 0;
+	unsigned int high = pendingIds.size();
+
+	while(low < high)
+	{
+		unsigned int middle = low + (high - low) / 2;
+		int before = lower_bound(ids.begin(), ids.end(), pendingIds[middle]) - ids.begin();
+
+		if(getPrefix(before) + pendingTotals[middle] <= r)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	// Running totals only grow in order of id, so the earlier of the two is the first of all
+	if(low == pendingIds.size() || (node < size && ids[node] < pendingIds[low]))
+		return ids[node];
+
+	return pendingIds[low];
+}
+
+
+// Returns the sum of the counts in the table
+int CumulativeTable::getTotal() const
+{
+	return total;
+}
@@ -0,0 +1,83 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * CumulativeTable.h: Declaration of the CumulativeTable class. Samples links by binary search.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CUMULATIVE_TABLE_H
+#define CUMULATIVE_TABLE_H
+
+#include "WordLink.h"
+#include "NGramTable.h"
+#include "Random.h"
+#include <vector>
+#include <map>
+
+// The most words that wait beside a tree before they're merged into it. Merging takes time in
+// proportion to the size of the tree, and sampling searches the waiting words once for each
+// level of the tree.
+#define CUMULATIVE_MAX_PENDING 256
+
+using namespace std;
+
+// A Fenwick tree over the prefix or postfix counts of a Word's links, or the counts of the words
+// seen next to an NGramTable context. Choosing a weighted random word is a binary search over
+// the running totals, and unlike an AliasTable the table is updated in place as counts change.
+//
+// The words are in order of their ids, which is the order a FrozenChain keeps its links in, so
+// the same engine draws the same word from a chain, from the chain reloaded from its file and
+// from a snapshot of either, however the links were first added. A word with a higher id than
+// any in the tree, which is where a word new to the chain goes, extends the tree at its end.
+// Other new words wait in a short sorted list beside the tree, which sampling searches along
+// with it, until there are enough of them to be worth merging into the tree.
+class CumulativeTable
+{
+private:
+	// The id of the word at each position of the tree, in increasing order
+	vector<WordId> ids;
+
+	// The tree, one node per position. Node i (counting from 1) holds the sum of the counts of
+	// the lowest-bit-of-i positions ending with position i - 1
+	vector<int> tree;
+
+	// The words waiting to be merged into the tree, in increasing order of id, and the running
+	// totals of their counts. None of them is in the tree, and all come before its last word.
+	vector<WordId> pendingIds;
+	vector<int> pendingTotals;
+
+	// The sum of all counts in the table
+	int total;
+
+	void append(WordId, int);
+	void addPending(WordId, int);
+	void merge();
+	void sum();
+	int getPrefix(int) const;
+	int getPendingBefore(WordId) const;
+
+public:
+	CumulativeTable();
+	CumulativeTable(const WordLinks&, int);
+	CumulativeTable(const vector<NGramEdge>&);
+
+	void build(const WordLinks&, int);
+	void build(const vector<NGramEdge>&);
+	void add(WordId, int);
+	WordId sample(Random&) const;
+	int getTotal() const;
+};
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Dictionary.cpp: Definition of the Dictionary class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Dictionary.h"
+#include <cstring>
+
+// The size of each block of word text. Longer words get a block of their own
+#define DICTIONARY_BLOCK_SIZE 65536
+
+// The number of slots in a new hash table
+#define DICTIONARY_MIN_SLOTS 16
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Private Static Members -----------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Hashes the given text 8 bytes at a time
+unsigned int Dictionary::hash(string_view text)
+{
+	const char* data = text.data();
+	size_t length = text.length();
+	unsigned long long h = 0xcbf29ce484222325ULL ^ length;
+	size_t i = 0;
+
+	for(; i + 8 <= length; i += 8)
+	{
+		unsigned long long chunk;
+		memcpy(&chunk, data + i, 8);
+
+		h = (h ^ chunk) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+
+	for(; i < length; i++)
+		h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+
+	// Fold the well mixed upper bits down, since the table is indexed by the lower ones
+	h *= 0x9e3779b97f4a7c15ULL;
+	return (unsigned int)(h >> 32);
+}
+
+
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
+
+
+// Copies the given text into the blocks and returns where it was copied
+const char* Dictionary::store(string_view text)
+{
+	size_t length = text.length();
+
+	if(blocks.empty())
+	{
+		blocks.push_back(new char[DICTIONARY_BLOCK_SIZE]);
+		blockUsed = 0;
+		blockBytes += DICTIONARY_BLOCK_SIZE;
+	}
+
+	// A word too long for a block gets a block of its own. It's inserted before the last
+	// block so that the last block can still be filled.
+	if(length > DICTIONARY_BLOCK_SIZE)
+	{
+		char* block = new char[length];
+		memcpy(block, text.data(), length);
+		blocks.insert(blocks.end() - 1, block);
+		blockBytes += length;
+
+		return block;
+	}
+
+	if(blockUsed + length > DICTIONARY_BLOCK_SIZE)
+	{
+		blocks.push_back(new char[DICTIONARY_BLOCK_SIZE]);
+		blockUsed = 0;
+		blockBytes += DICTIONARY_BLOCK_SIZE;
+	}
+
+	char* destination = blocks.back() + blockUsed;
+	memcpy(destination, text.data(), length);
+	blockUsed += length;
+
+	return destination;
+}
+
+
+// Returns the slot holding the word with the given text and hash, or the empty slot where
+// it would go if it isn't in the dictionary. Collisions are resolved by linear probing.
+size_t Dictionary::findSlot(string_view text, unsigned int h) const
+{
+	size_t mask = slots.size() - 1;
+	size_t i = h & mask;
+
+	while(slots[i] != NO_WORD)
+	{
+		WordId id = slots[i];
+		if(hashes[id] == h && texts[id] == text)
+			return i;
+
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
+
+
+// Doubles the number of slots and puts every word back in its new slot
+void Dictionary::grow()
+{
+	size_t slotCount = slots.empty() ? DICTIONARY_MIN_SLOTS : slots.size() * 2;
+	slots.assign(slotCount, NO_WORD);
+
+	size_t mask = slotCount - 1;
+	for(WordId id = 0; id < (WordId)texts.size(); id++)
+	{
+		size_t i = hashes[id] & mask;
+		while(slots[i] != NO_WORD)
+			i = (i + 1) & mask;
+
+		slots[i] = id;
+	}
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty dictionary. Nothing is allocated until the first word is added
+Dictionary::Dictionary()
+{
+	blockUsed = 0;
+	blockBytes = 0;
+}
+
+
+// Frees the text blocks
+Dictionary::~Dictionary()
+{
+	clear();
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Returns the id of the word with the given text, or NO_WORD if it isn't in the dictionary
+WordId Dictionary::find(string_view text) const
+{
+	if(slots.empty())
+		return NO_WORD;
+
+	return slots[findSlot(text, hash(text))];
+}
+
+
+// Looks up each of the given number of words and writes its id, or NO_WORD, to ids. Every
+// word is hashed and its first slot fetched before any is compared, so the cache misses of
+// the lookups overlap rather than following one another.
+void Dictionary::findAll(const string_view* words, unsigned int count, WordId* ids) const
+{
+	if(slots.empty())
+	{
+		for(unsigned int i = 0; i < count; i++)
+			ids[i] = NO_WORD;
+
+		return;
+	}
+
+	// Hold each word's hash in its id until it's looked up
+	size_t mask = slots.size() - 1;
+	for(unsigned int i = 0; i < count; i++)
+	{
+		unsigned int h = hash(words[i]);
+		ids[i] = (WordId)h;
+
+#if defined(__GNUC__)
+		__builtin_prefetch(&slots[h & mask]);
+#endif
+	}
+
+	for(unsigned int i = 0; i < count; i++)
+		ids[i] = slots[findSlot(words[i], (unsigned int)ids[i])];
+}
+
+
+// Returns the id of the word with the given text, adding it with the next id if it
+// isn't in the dictionary yet
+WordId Dictionary::intern(string_view text)
+{
+	// Keep at most half of the slots full so that probe sequences stay short
+	if(slots.size() < 2 * (texts.size() + 1))
+		grow();
+
+	unsigned int h = hash(text);
+	size_t slot = findSlot(text, h);
+
+	if(slots[slot] != NO_WORD)
+		return slots[slot];
+
+	WordId id = texts.size();
+	texts.push_back(string_view(store(text), text.length()));
+	hashes.push_back(h);
+	slots[slot] = id;
+
+	return id;
+}
+
+
+// Returns the text of the word with the given id. It stays valid until the dictionary is cleared
+string_view Dictionary::getText(WordId id) const
+{
+	return texts[id];
+}
+
+
+// Returns the number of words in the dictionary
+unsigned int Dictionary::size() const
+{
+	return texts.size();
+}
+
+
+// Removes every word and frees the text blocks. The next word added will have id 0
+void Dictionary::clear()
+{
+	for(unsigned int i = 0; i < blocks.size(); i++)
+		delete[] blocks[i];
+
+	blocks.clear();
+	blockUsed = 0;
+	blockBytes = 0;
+
+	vector<string_view>().swap(texts);
+	vector<unsigned int>().swap(hashes);
+	vector<WordId>().swap(slots);
+}
+
+
+// Returns the number of bytes held by the dictionary for text, per-word records and slots
+size_t Dictionary::getMemoryUsage() const
+{
+	return blockBytes
+		+ texts.capacity() * sizeof(string_view)
+		+ hashes.capacity() * sizeof(unsigned int)
+		+ slots.capacity() * sizeof(WordId);
+}
@@ -0,0 +1,80 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Dictionary.h: Declaration of the Dictionary class. Interns word text and numbers each word.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <vector>
+#include <string_view>
+
+using namespace std;
+
+// The number given to a word by a Dictionary. Ids are dense, starting at 0 in the order the
+// words were added, and never change while the word is in the dictionary.
+typedef int WordId;
+
+// Returned in place of a WordId when there is no such word
+#define NO_WORD -1
+
+// An open-addressing hash table from word text to WordId. The text of every word is copied
+// once into large blocks owned by the dictionary, so the text of a word is a pointer into
+// those blocks that stays valid until the dictionary is cleared. Looking up a word hashes
+// it once and compares text only against entries with the same hash.
+class Dictionary
+{
+private:
+	// Blocks of word text. Text is never moved once written
+	vector<char*> blocks;
+
+	// The number of bytes used in the last block, and allocated in all blocks
+	size_t blockUsed;
+	size_t blockBytes;
+
+	// The text and hash of each word, indexed by id
+	vector<string_view> texts;
+	vector<unsigned int> hashes;
+
+	// The hash table. Each slot holds the id of a word or NO_WORD. The number of slots is
+	// a power of two and is kept at least twice the number of words.
+	vector<WordId> slots;
+
+	static unsigned int hash(string_view);
+
+	const char* store(string_view);
+	size_t findSlot(string_view, unsigned int) const;
+	void grow();
+
+	// Dictionaries own their text blocks, so they aren't copied
+	Dictionary(const Dictionary&);
+	Dictionary& operator=(const Dictionary&);
+
+public:
+	Dictionary();
+	~Dictionary();
+
+	WordId find(string_view) const;
+	void findAll(const string_view*, unsigned int, WordId*) const;
+	WordId intern(string_view);
+	string_view getText(WordId) const;
+	unsigned int size() const;
+	void clear();
+	size_t getMemoryUsage() const;
+};
+
+#endif
@@ -0,0 +1,1535 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * FrozenChain.cpp: Definition of the FrozenChain class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FrozenChain.h"
+#include "MarkovChain.h"
+#include "Word.h"
+#include "NGramTable.h"
+#include "GenerationBuffer.h"
+#include "Tokenizer.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// The number of arrays following the header, and the boundary each of them is aligned to
+#define FROZEN_SECTIONS 16
+#define FROZEN_ALIGNMENT 8
+
+// Appends a number to the end of the bytes, 7 bits to a byte starting from the lowest, with
+// the high bit set on every byte but the last. Most counts and target differences take one.
+static void writeVarint(vector<char>& bytes, unsigned int value)
+{
+	while(value >= 0x80)
+	{
+		bytes.push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+
+	bytes.push_back((char)value);
+}
+
+// The links of one share of the lists of a section, encoded apart from the other shares so
+// that each share can be encoded on a thread of its own. The offsets are from the start of
+// the share, in the units of the section's offsets.
+struct FrozenShare
+{
+	vector<char> bytes;
+	vector<unsigned int> offsets;
+	unsigned int edgeCount;
+};
+
+// Reads a number written by writeVarint and moves past it
+static inline unsigned int readVarint(const unsigned char*& bytes)
+{
+	unsigned int value = *bytes++;
+	if(value < 0x80)
+		return value;
+
+	value &= 0x7F;
+	for(int shift = 7; shift < 35; shift += 7)
+	{
+		unsigned int byte = *bytes++;
+		value |= (byte & 0x7F) << shift;
+
+		if(byte < 0x80)
+			break;
+	}
+
+	return value;
+}
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Private Static Members -----------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Computes where each array of an image with the given header begins, in the order
+// textOffsets, occurrences, postfixOffsets, prefixOffsets, postfixEdges, prefixEdges, the
+// keys, offsets, edges and slots of the postfix contexts and then the prefix contexts,
+// text, and textOrder. Returns the total size of the image.
+size_t FrozenChain::layout(const FrozenHeader& header, size_t* offsets)
+{
+	size_t wordCount = header.wordCount;
+	size_t order = header.order;
+	size_t sizes[FROZEN_SECTIONS] =
+	{
+		(wordCount + 1) * sizeof(unsigned int),
+		wordCount * sizeof(unsigned int),
+		(wordCount + 1) * sizeof(unsigned int),
+		(wordCount + 1) * sizeof(unsigned int),
+		header.postfixEdgeSize,
+		header.prefixEdgeSize,
+		header.postfixContextCount * order * sizeof(unsigned int),
+		(header.postfixContextCount + 1) * sizeof(unsigned int),
+		header.postfixContextEdgeSize,
+		header.postfixSlotCount * sizeof(unsigned int),
+		header.prefixContextCount * order * sizeof(unsigned int),
+		(header.prefixContextCount + 1) * sizeof(unsigned int),
+		header.prefixContextEdgeSize,
+		header.prefixSlotCount * sizeof(unsigned int),
+		header.textSize,
+		wordCount * sizeof(unsigned int)
+	};
+
+	size_t offset = (sizeof(FrozenHeader) + FROZEN_ALIGNMENT - 1) & ~(size_t)(FROZEN_ALIGNMENT - 1);
+
+	for(int i = 0; i < FROZEN_SECTIONS; i++)
+	{
+		offsets[i] = offset;
+		offset = (offset + sizes[i] + FROZEN_ALIGNMENT - 1) & ~(size_t)(FROZEN_ALIGNMENT - 1);
+	}
+
+	return offset;
+}
+
+
+// Continues the two running sums of checksum over the given bytes, taken as 32-bit words
+void FrozenChain::sumWords(const char* data, size_t size, unsigned long long& a, unsigned long long& b)
+{
+	const unsigned int* words = (const unsigned int*)data;
+	size_t count = size / sizeof(unsigned int);
+
+	for(size_t i = 0; i < count; i++)
+	{
+		a += words[i];
+		b += a;
+	}
+}
+
+
+// A Fletcher-style checksum over the given bytes, taken as 32-bit words. The size must
+// be a multiple of 4, which every image section is after alignment.
+unsigned int FrozenChain::checksum(const char* data, size_t size)
+{
+	return checksum(data, size, 1);
+}
+
+
+// Takes the same checksum on the given number of threads. Each thread sums one part of the
+// bytes from zero. Over a part of n words that gives a, the sum of the words, and b, the sum
+// of the running totals, so starting the part at some a0 instead would only add a0 to each of
+// its running totals. The parts are then combined in order: b grows by n * a0 plus the
+// part's own b, and a by the part's a.
+unsigned int FrozenChain::checksum(const char* data, size_t size, int threadCount)
+{
+	size_t count = size / sizeof(unsigned int);
+	if(threadCount < 1 || count < (size_t)threadCount)
+		threadCount = 1;
+
+	vector<unsigned long long> sums(2 * threadCount, 0);
+	vector<size_t> bounds(threadCount + 1);
+	for(int i = 0; i <= threadCount; i++)
+		bounds[i] = count * i / threadCount;
+
+	auto sumPart = [&](int part)
+	{
+		sumWords(data + bounds[part] * sizeof(unsigned int), (bounds[part + 1] - bounds[part]) * sizeof(unsigned int),
+			sums[2 * part], sums[2 * part + 1]);
+	};
+
+	vector<thread> threads;
+	for(int i = 1; i < threadCount; i++)
+		threads.push_back(thread(sumPart, i));
+
+	sumPart(0);
+
+	for(unsigned int i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	unsigned long long a = 1;
+	unsigned long long b = 0;
+
+	for(int i = 0; i < threadCount; i++)
+	{
+		b += (bounds[i + 1] - bounds[i]) * a + sums[2 * i + 1];
+		a += sums[2 * i];
+	}
+
+	return (unsigned int)(a ^ (a >> 32) ^ b ^ (b >> 32));
+}
+
+
+// Splits lists with the given weights into the given number of contiguous shares of about the
+// same total weight. Share i is the lists from bounds[i] up to bounds[i + 1]. A list heavier
+// than a share gets a share to itself, and the last shares may be empty.
+void FrozenChain::splitShares(const vector<size_t>& weights, int shareCount, vector<unsigned int>& bounds)
+{
+	size_t total = 0;
+	for(unsigned int i = 0; i < weights.size(); i++)
+		total += weights[i];
+
+	bounds.assign(1, 0);
+	size_t weight = 0;
+
+	for(unsigned int i = 0; i < weights.size() && (int)bounds.size() < shareCount; i++)
+	{
+		weight += weights[i];
+
+		// Close the share once the shares so far hold their part of the total
+		if(weight * shareCount >= total * bounds.size())
+			bounds.push_back(i + 1);
+	}
+
+	bounds.resize(shareCount + 1, weights.size());
+}
+
+
+// Appends one list of links to the end of a direction's links in the given format. The
+// links hold their own counts in place of running totals, and are sorted by target here.
+void FrozenChain::appendEdges(vector<FrozenEdge>& links, int edgeFormat, vector<char>& bytes)
+{
+	sort(links.begin(), links.end(), [](const FrozenEdge& a, const FrozenEdge& b)
+	{
+		return a.target < b.target;
+	});
+
+	unsigned int total = 0;
+
+	if(edgeFormat == FROZEN_EDGES_PLAIN)
+	{
+		size_t first = bytes.size();
+		bytes.resize(first + links.size() * sizeof(FrozenEdge));
+
+		for(unsigned int i = 0; i < links.size(); i++)
+		{
+			total += links[i].cumulative;
+
+			FrozenEdge edge = {links[i].target, total};
+			memcpy(&bytes[first + i * sizeof(FrozenEdge)], &edge, sizeof(edge));
+		}
+
+		return;
+	}
+
+	// An empty list takes no bytes at all
+	if(links.empty())
+		return;
+
+	for(unsigned int i = 0; i < links.size(); i++)
+		total += links[i].cumulative;
+
+	writeVarint(bytes, links.size());
+	writeVarint(bytes, total);
+
+	// Leave room for the restart points, which are filled in as their blocks are reached
+	unsigned int blockCount = (links.size() - 1) / FROZEN_BLOCK_SIZE;
+	size_t restarts = bytes.size();
+	bytes.resize(restarts + blockCount * 2 * sizeof(unsigned int));
+
+	size_t first = bytes.size();
+	unsigned int cumulative = 0;
+	unsigned int previous = 0;
+
+	for(unsigned int i = 0; i < links.size(); i++)
+	{
+		if(i % FROZEN_BLOCK_SIZE == 0)
+		{
+			previous = 0;
+
+			if(i > 0)
+			{
+				unsigned int restart[2] = {cumulative, (unsigned int)(bytes.size() - first)};
+				memcpy(&bytes[restarts + (i / FROZEN_BLOCK_SIZE - 1) * sizeof(restart)], restart, sizeof(restart));
+			}
+		}
+
+		writeVarint(bytes, links[i].target - previous);
+		writeVarint(bytes, links[i].cumulative);
+
+		previous = links[i].target;
+		cumulative += links[i].cumulative;
+	}
+}
+
+
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
+
+
+// Points the arrays at the sections of the given image after checking that the header
+// describes an image of exactly the given size. The contents are not checked here.
+bool FrozenChain::attach(const char* image, size_t size)
+{
+	if(size < sizeof(FrozenHeader))
+		return false;
+
+	const FrozenHeader* imageHeader = (const FrozenHeader*)image;
+	if(memcmp(imageHeader->magic, "MQVC", 4) != 0 || imageHeader->version != FROZEN_VERSION)
+		return false;
+
+	size_t offsets[FROZEN_SECTIONS];
+	if(layout(*imageHeader, offsets) != size)
+		return false;
+
+	unsigned int wordCount = imageHeader->wordCount;
+	if(imageHeader->start >= wordCount || imageHeader->end >= wordCount)
+		return false;
+
+	if(imageHeader->edgeFormat != FROZEN_EDGES_PLAIN && imageHeader->edgeFormat != FROZEN_EDGES_PACKED)
+		return false;
+
+	textOffsets = (const unsigned int*)(image + offsets[0]);
+	occurrences = (const unsigned int*)(image + offsets[1]);
+	postfixOffsets = (const unsigned int*)(image + offsets[2]);
+	prefixOffsets = (const unsigned int*)(image + offsets[3]);
+	postfixEdges = image + offsets[4];
+	prefixEdges = image + offsets[5];
+	text = image + offsets[14];
+	textOrder = (const unsigned int*)(image + offsets[15]);
+
+	postfixGrams.count = imageHeader->postfixContextCount;
+	postfixGrams.slotCount = imageHeader->postfixSlotCount;
+	postfixGrams.keys = (const unsigned int*)(image + offsets[6]);
+	postfixGrams.offsets = (const unsigned int*)(image + offsets[7]);
+	postfixGrams.edges = image + offsets[8];
+	postfixGrams.slots = (const unsigned int*)(image + offsets[9]);
+
+	prefixGrams.count = imageHeader->prefixContextCount;
+	prefixGrams.slotCount = imageHeader->prefixSlotCount;
+	prefixGrams.keys = (const unsigned int*)(image + offsets[10]);
+	prefixGrams.offsets = (const unsigned int*)(image + offsets[11]);
+	prefixGrams.edges = image + offsets[12];
+	prefixGrams.slots = (const unsigned int*)(image + offsets[13]);
+
+	// The ends of the offset arrays must agree with the header, or a lookup could run off the image
+	if(textOffsets[wordCount] != imageHeader->textSize)
+		return false;
+
+	// Plain offsets count edges, which must fill their section exactly. Packed offsets count bytes.
+	bool packed = imageHeader->edgeFormat == FROZEN_EDGES_PACKED;
+	size_t unit = packed ? 1 : sizeof(FrozenEdge);
+
+	unsigned int ends[4] = {postfixOffsets[wordCount], prefixOffsets[wordCount], postfixGrams.offsets[postfixGrams.count], prefixGrams.offsets[prefixGrams.count]};
+	unsigned int counts[4] = {imageHeader->postfixEdgeCount, imageHeader->prefixEdgeCount, imageHeader->postfixContextEdgeCount, imageHeader->prefixContextEdgeCount};
+	unsigned int sizes[4] = {imageHeader->postfixEdgeSize, imageHeader->prefixEdgeSize, imageHeader->postfixContextEdgeSize, imageHeader->prefixContextEdgeSize};
+
+	for(int i = 0; i < 4; i++)
+	{
+		if((size_t)ends[i] * unit != sizes[i] || (!packed && ends[i] != counts[i]))
+			return false;
+	}
+
+	// Context lookups mask hashes by the slot count and stop at an empty slot, so there must
+	// be a power of two of them and more than there are contexts
+	const FrozenContexts* grams[2] = {&postfixGrams, &prefixGrams};
+	for(int t = 0; t < 2; t++)
+	{
+		unsigned int slotCount = grams[t]->slotCount;
+		if((slotCount & (slotCount - 1)) != 0 || (grams[t]->count > 0 && slotCount <= grams[t]->count))
+			return false;
+	}
+
+	if(imageHeader->order < 1)
+		return false;
+
+	header = imageHeader;
+	imageSize = size;
+	start = header->start;
+	end = header->end;
+
+	return true;
+}
+
+
+// Gives up the image, unmapping it if it was mapped, and leaves the snapshot empty
+void FrozenChain::release()
+{
+#ifndef _WIN32
+	if(mapping != NULL)
+		munmap(mapping, mappingSize);
+#endif
+
+	vector<char>().swap(buffer);
+	mapping = NULL;
+	mappingSize = 0;
+
+	header = NULL;
+	imageSize = 0;
+	textOffsets = NULL;
+	occurrences = NULL;
+	postfixOffsets = NULL;
+	prefixOffsets = NULL;
+	postfixEdges = NULL;
+	prefixEdges = NULL;
+	memset(&postfixGrams, 0, sizeof(postfixGrams));
+	memset(&prefixGrams, 0, sizeof(prefixGrams));
+	text = NULL;
+	textOrder = NULL;
+	start = FROZEN_NONE;
+	end = FROZEN_NONE;
+}
+
+
+// Chooses a random link of the given word from one direction's arrays, weighted by count.
+// Returns FROZEN_NONE if the word has no links in that direction.
+unsigned int FrozenChain::sample(const unsigned int* offsets, const char* edges, unsigned int word, Random& random) const
+{
+	unsigned int first = offsets[word];
+	unsigned int last = offsets[word + 1];
+
+	if(first == last)
+		return FROZEN_NONE;
+
+	if(header->edgeFormat == FROZEN_EDGES_PACKED)
+		return samplePacked((const unsigned char*)edges + first, (const unsigned char*)edges + last, random);
+
+	const FrozenEdge* plainEdges = (const FrozenEdge*)edges;
+
+	// The last cumulative count is the total of all of the word's links
+	unsigned int r = random.nextInt(plainEdges[last - 1].cumulative);
+
+	// The chosen link is the first whose cumulative count passes r
+	const FrozenEdge* edge = upper_bound(plainEdges + first, plainEdges + last, r,
+		[](unsigned int value, const FrozenEdge& e) { return value < e.cumulative; });
+
+	return edge->target;
+}
+
+
+// Chooses a random link from the packed list between the given bytes, weighted by count. Only
+// the block holding the chosen link is decoded, so the work is a binary search over the
+// restart points and at most FROZEN_BLOCK_SIZE links.
+unsigned int FrozenChain::samplePacked(const unsigned char* list, const unsigned char* listEnd, Random& random) const
+{
+	unsigned int count = readVarint(list);
+	unsigned int total = readVarint(list);
+	unsigned int r = random.nextInt(total);
+
+	unsigned int blockCount = (count - 1) / FROZEN_BLOCK_SIZE;
+	const unsigned char* links = list + blockCount * 2 * sizeof(unsigned int);
+
+	// Find the last restart point whose running total doesn't pass r
+	unsigned int restart[2];
+	unsigned int low = 0;
+	unsigned int high = blockCount;
+
+	while(low < high)
+	{
+		unsigned int middle = low + (high - low) / 2;
+		memcpy(restart, list + middle * sizeof(restart), sizeof(restart));
+
+		if(restart[0] <= r)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	unsigned int cumulative = 0;
+	const unsigned char* link = links;
+
+	if(low > 0)
+	{
+		memcpy(restart, list + (low - 1) * sizeof(restart), sizeof(restart));
+		cumulative = restart[0];
+		link = links + restart[1];
+	}
+
+	// The chosen link is the first whose running total passes r
+	unsigned int target = 0;
+	while(link < listEnd)
+	{
+		target += readVarint(link);
+		cumulative += readVarint(link);
+
+		if(r < cumulative)
+			return target;
+	}
+
+	return FROZEN_NONE;
+}
+
+
+// Replaces the contents of out with the links of the given word or context as FrozenEdges,
+// whichever format they're stored in
+void FrozenChain::getEdges(const unsigned int* offsets, const char* edges, unsigned int list, vector<FrozenEdge>& out) const
+{
+	out.clear();
+
+	unsigned int first = offsets[list];
+	unsigned int last = offsets[list + 1];
+
+	if(first == last)
+		return;
+
+	if(header->edgeFormat == FROZEN_EDGES_PLAIN)
+	{
+		const FrozenEdge* plainEdges = (const FrozenEdge*)edges;
+		out.assign(plainEdges + first, plainEdges + last);
+		return;
+	}
+
+	const unsigned char* link = (const unsigned char*)edges + first;
+	unsigned int count = readVarint(link);
+	readVarint(link);
+
+	link += (count - 1) / FROZEN_BLOCK_SIZE * 2 * sizeof(unsigned int);
+
+	FrozenEdge edge = {0, 0};
+	for(unsigned int i = 0; i < count; i++)
+	{
+		// Targets start over at each block
+		if(i % FROZEN_BLOCK_SIZE == 0)
+			edge.target = 0;
+
+		edge.target += readVarint(link);
+		edge.cumulative += readVarint(link);
+		out.push_back(edge);
+	}
+}
+
+
+// Returns the number of the given context in one direction's contexts, or FROZEN_NONE if
+// it was never seen
+unsigned int FrozenChain::findContext(const FrozenContexts& grams, const unsigned int* context) const
+{
+	if(grams.slotCount == 0)
+		return FROZEN_NONE;
+
+	unsigned int order = header->order;
+	unsigned int mask = grams.slotCount - 1;
+	unsigned int slot = NGramTable::hash((const WordId*)context, order) & mask;
+
+	while(grams.slots[slot] != FROZEN_NONE)
+	{
+		unsigned int number = grams.slots[slot];
+		if(memcmp(grams.keys + (size_t)number * order, context, order * sizeof(unsigned int)) == 0)
+			return number;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return FROZEN_NONE;
+}
+
+
+// Returns the count of the link to the given target among the links of the given word or
+// context, or 0 if there is none, and sets total to the total of all of them. Plain links are
+// binary searched by target. Packed links are found by a binary search of the first target
+// of each block, which is stored whole, and a walk of at most one block.
+unsigned int FrozenChain::getLinkCount(const unsigned int* offsets, const char* edges, unsigned int list, unsigned int target, unsigned int& total) const
+{
+	unsigned int first = offsets[list];
+	unsigned int last = offsets[list + 1];
+
+	total = 0;
+	if(first == last)
+		return 0;
+
+	if(header->edgeFormat == FROZEN_EDGES_PLAIN)
+	{
+		const FrozenEdge* plainEdges = (const FrozenEdge*)edges;
+		total = plainEdges[last - 1].cumulative;
+
+		const FrozenEdge* edge = lower_bound(plainEdges + first, plainEdges + last, target,
+			[](const FrozenEdge& e, unsigned int value) { return e.target < value; });
+
+		if(edge == plainEdges + last || edge->target != target)
+			return 0;
+
+		return edge->cumulative - ((edge == plainEdges + first) ? 0 : (edge - 1)->cumulative);
+	}
+
+	const unsigned char* packed = (const unsigned char*)edges + first;
+	const unsigned char* packedEnd = (const unsigned char*)edges + last;
+
+	unsigned int count = readVarint(packed);
+	total = readVarint(packed);
+
+	unsigned int blockCount = (count - 1) / FROZEN_BLOCK_SIZE;
+	const unsigned char* links = packed + blockCount * 2 * sizeof(unsigned int);
+
+	// Find the last block whose first target doesn't pass the target. Block b after the
+	// first starts where restart point b - 1 says.
+	unsigned int restart[2];
+	unsigned int low = 0;
+	unsigned int high = blockCount;
+
+	while(low < high)
+	{
+		unsigned int middle = low + (high - low + 1) / 2;
+		memcpy(restart, packed + (middle - 1) * sizeof(restart), sizeof(restart));
+
+		const unsigned char* blockStart = links + restart[1];
+		if(readVarint(blockStart) <= target)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	const unsigned char* link = links;
+	if(low > 0)
+	{
+		memcpy(restart, packed + (low - 1) * sizeof(restart), sizeof(restart));
+		link = links + restart[1];
+	}
+
+	unsigned int linkTarget = 0;
+	for(int i = 0; i < FROZEN_BLOCK_SIZE && link < packedEnd; i++)
+	{
+		linkTarget += readVarint(link);
+		unsigned int linkCount = readVarint(link);
+
+		if(linkTarget == target)
+			return linkCount;
+
+		if(linkTarget > target)
+			break;
+	}
+
+	return 0;
+}
+
+
+// Multiplies the probability of each sentence of the given text into the score, as
+// scoreSentence describes, using the calling thread's buffer for the words. For an order
+// above 1, a word is predicted from the run of words before it when that run was seen,
+// and from the single word before it otherwise, as generation chooses it.
+void FrozenChain::scoreText(string_view text, double smoothing, SentenceScore& score) const
+{
+	GenerationBuffer& buffer = GenerationBuffer::local();
+	vector<string_view>& textWords = buffer.seedWords;
+	vector<unsigned int>& sentenceEnds = buffer.sentenceEnds;
+	vector<unsigned int>& padded = buffer.seedIds;
+
+	Tokenizer::tokenize(text, textWords, sentenceEnds);
+
+	unsigned int order = header->order;
+	unsigned int vocabulary = getWordCount() - 1;
+	unsigned int begin = 0;
+
+	for(unsigned int s = 0; s < sentenceEnds.size(); s++)
+	{
+		// Each sentence is preceded by order starts and followed by an end, as it was added
+		padded.assign(order, start);
+		for(unsigned int i = begin; i < sentenceEnds[s]; i++)
+		{
+			unsigned int word = findWord(textWords[i]);
+			if(word == FROZEN_NONE)
+				score.unknownCount++;
+
+			padded.push_back(word);
+		}
+
+		begin = sentenceEnds[s];
+		if(padded.size() == order)
+			continue;
+
+		padded.push_back(end);
+
+		for(unsigned int i = order; i < padded.size(); i++)
+		{
+			unsigned int count = 0;
+			unsigned int total = 0;
+			unsigned int number = (order > 1) ? findContext(postfixGrams, &padded[i - order]) : FROZEN_NONE;
+
+			if(number != FROZEN_NONE)
+				count = getLinkCount(postfixGrams.offsets, postfixGrams.edges, number, padded[i], total);
+			else if(padded[i - 1] != FROZEN_NONE)
+				count = getLinkCount(postfixOffsets, postfixEdges, padded[i - 1], padded[i], total);
+
+			score.addPrediction(count, total, smoothing, vocabulary);
+		}
+	}
+}
+
+
+// Finds the word to generate around for the given seed text, in the same manner as
+// MarkovChain::findSeed: one of the seed's words found in the snapshot, chosen at random,
+// or start if there are none. Words are matched exactly.
+unsigned int FrozenChain::findSeed(string_view seed, Random& random) const
+{
+	GenerationBuffer& buffer = GenerationBuffer::local();
+	vector<string_view>& seedWords = buffer.seedWords;
+	vector<unsigned int>& seedIds = buffer.seedIds;
+
+	MarkovChain::tokenize(seed, seedWords);
+	seedIds.clear();
+
+	for(unsigned int i = 0; i < seedWords.size(); i++)
+	{
+		unsigned int word = findWord(seedWords[i]);
+		if(word != FROZEN_NONE)
+			seedIds.push_back(word);
+	}
+
+	if(seedIds.empty())
+		return start;
+
+	return seedIds[random.nextInt(seedIds.size())];
+}
+
+
+// Chooses the next word of the string being generated in the given direction, in the same
+// manner as MarkovChain::getRandomNext
+unsigned int FrozenChain::getRandomNext(int direction, unsigned int word, bool terminated, GenerationBuffer& buffer, Random& random) const
+{
+	unsigned int order = header->order;
+
+	if(order > 1)
+	{
+		unsigned int terminator = (direction == GENERATE_POSTFIX) ? start : end;
+		const FrozenContexts& grams = (direction == GENERATE_POSTFIX) ? postfixGrams : prefixGrams;
+
+		buffer.context.resize(order);
+		if(buffer.getContext(direction, terminated, terminator, order, &buffer.context[0]))
+		{
+			unsigned int number = findContext(grams, &buffer.context[0]);
+			if(number != FROZEN_NONE)
+				return sample(grams.offsets, grams.edges, number, random);
+		}
+	}
+
+	return (direction == GENERATE_POSTFIX) ? getRandomPostfix(word, random) : getRandomPrefix(word, random);
+}
+
+
+// Generates one semi-random string in the same manner as generateString and writes it to
+// the end of the buffer, holding word indices in the buffer's ring until both ends are found
+void FrozenChain::appendString(int direction, unsigned int seed, int maxWordCount, GenerationBuffer& buffer, Random& random) const
+{
+	buffer.startString(maxWordCount);
+
+	// A real seed word is in the middle of the string
+	if(seed != start && seed != end)
+		buffer.pushBack(seed);
+
+	unsigned int ws = seed;
+	unsigned int we = seed;
+
+	bool startReached = (direction & GENERATE_PREFIX) == 0 || ws == start;
+	bool endReached = (direction & GENERATE_POSTFIX) == 0 || we == end;
+
+	for(int i = 0; i < maxWordCount;)
+	{
+		if(startReached && endReached)
+			break;
+
+		if(!startReached)
+		{
+			ws = getRandomNext(GENERATE_PREFIX, ws, we == end, buffer, random);
+			i++;
+
+			if(ws == start || ws == FROZEN_NONE)
+				startReached = true;
+			else
+				buffer.pushFront(ws);
+		}
+
+		if(!endReached)
+		{
+			we = getRandomNext(GENERATE_POSTFIX, we, ws == start, buffer, random);
+			i++;
+
+			if(we == end || we == FROZEN_NONE)
+				endReached = true;
+			else
+				buffer.pushBack(we);
+		}
+	}
+
+	// Measure the string first, so the text grows once and each word, followed by a space,
+	// is copied straight into place
+	size_t length = 0;
+	for(unsigned int i = 0; i < buffer.wordCount; i++)
+	{
+		unsigned int word = buffer.getWord(i);
+		length += textOffsets[word + 1] - textOffsets[word] + 1;
+	}
+
+	char* output = buffer.extendText(length);
+	for(unsigned int i = 0; i < buffer.wordCount; i++)
+	{
+		unsigned int word = buffer.getWord(i);
+		unsigned int wordLength = textOffsets[word + 1] - textOffsets[word];
+
+		memcpy(output, text + textOffsets[word], wordLength);
+		output += wordLength;
+		*output++ = ' ';
+	}
+
+	buffer.finishString();
+}
+
+
+// Returns the engine to generate from when the caller gives none, as MarkovChain::getEngine does
+Random& FrozenChain::getEngine(Random& seededEngine) const
+{
+	if(!seeded)
+		return Random::local();
+
+	unsigned long long call = seededCalls.fetch_add(1, memory_order_relaxed);
+	seededEngine.seed(generationSeed + call * SEED_CALL_STRIDE);
+	return seededEngine;
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty snapshot. It has no words, not even start and end, until built or loaded
+FrozenChain::FrozenChain()
+{
+	mapping = NULL;
+	seeded = false;
+	generationSeed = 0;
+	seededCalls = 0;
+	release();
+}
+
+
+// Initializes a snapshot of the given chain
+FrozenChain::FrozenChain(const MarkovChain& chain)
+{
+	mapping = NULL;
+	seeded = false;
+	generationSeed = 0;
+	seededCalls = 0;
+	release();
+	build(chain);
+}
+
+
+// Initializes a snapshot of the given chain with its links in the given format
+FrozenChain::FrozenChain(const MarkovChain& chain, int edgeFormat)
+{
+	mapping = NULL;
+	seeded = false;
+	generationSeed = 0;
+	seededCalls = 0;
+	release();
+	build(chain, edgeFormat);
+}
+
+
+// Initializes a snapshot of the given chain with its links in the given format, encoded on the
+// given number of threads
+FrozenChain::FrozenChain(const MarkovChain& chain, int edgeFormat, int threadCount)
+{
+	mapping = NULL;
+	seeded = false;
+	generationSeed = 0;
+	seededCalls = 0;
+	release();
+	build(chain, edgeFormat, threadCount);
+}
+
+
+// Takes over the image of the given snapshot, leaving it empty
+FrozenChain::FrozenChain(FrozenChain&& other)
+{
+	mapping = NULL;
+	seeded = false;
+	generationSeed = 0;
+	seededCalls = 0;
+	release();
+	*this = std::move(other);
+}
+
+
+// Takes over the image of the given snapshot, leaving it empty
+FrozenChain& FrozenChain::operator=(FrozenChain&& other)
+{
+	if(this == &other)
+		return *this;
+
+	release();
+
+	const char* image = (const char*)other.header;
+	size_t size = other.imageSize;
+
+	// Moving the buffer keeps its storage, so the image stays where it was
+	buffer.swap(other.buffer);
+	mapping = other.mapping;
+	mappingSize = other.mappingSize;
+	seeded = other.seeded;
+	generationSeed = other.generationSeed;
+	seededCalls = other.seededCalls.load();
+	other.mapping = NULL;
+	other.release();
+
+	if(image != NULL)
+		attach(image, size);
+
+	return *this;
+}
+
+
+// Unmaps or frees the image
+FrozenChain::~FrozenChain()
+{
+	release();
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Replaces the contents of this snapshot with a compacted copy of the given chain, with
+// plain links
+void FrozenChain::build(const MarkovChain& chain)
+{
+	build(chain, FROZEN_EDGES_PLAIN);
+}
+
+
+// Replaces the contents of this snapshot with a compacted copy of the given chain, storing
+// its links in the given format, FROZEN_EDGES_PLAIN or FROZEN_EDGES_PACKED
+void FrozenChain::build(const MarkovChain& chain, int edgeFormat)
+{
+	build(chain, edgeFormat, 1);
+}
+
+
+// Replaces the contents of this snapshot with a compacted copy of the given chain, storing its
+// links in the given format and encoding them on the given number of threads. Every list of
+// links is found through its offset, so the words and contexts are split into shares of about
+// the same number of links, each share is encoded on its own thread, and the shares are copied
+// into place one after another. The image is the same for any number of threads. The chain
+// must not change while it's copied.
+void FrozenChain::build(const MarkovChain& chain, int edgeFormat, int threadCount)
+{
+	release();
+
+	// A snapshot generates as reproducibly as its chain
+	seeded = chain.seeded;
+	generationSeed = chain.generationSeed;
+	seededCalls = 0;
+
+	if(threadCount < 1)
+		threadCount = 1;
+
+	FrozenHeader newHeader;
+	memset(&newHeader, 0, sizeof(newHeader));
+	memcpy(newHeader.magic, "MQVC", 4);
+	newHeader.version = FROZEN_VERSION;
+	newHeader.order = chain.order;
+	newHeader.edgeFormat = edgeFormat;
+	newHeader.wordCount = chain.words.size();
+
+	// Words keep the ids the chain gave them, so a chain loaded from the image numbers them the
+	// same way and samples their links in the same order. They are listed again in order of
+	// their text, so findWord can binary search the text.
+	vector<WordId> sorted(newHeader.wordCount);
+	for(unsigned int i = 0; i < sorted.size(); i++)
+	{
+		sorted[i] = i;
+		newHeader.textSize += chain.words[i]->getText().length();
+	}
+
+	sort(sorted.begin(), sorted.end(), [&chain](WordId a, WordId b)
+	{
+		return chain.words[a]->getText() < chain.words[b]->getText();
+	});
+
+	newHeader.start = chain.start->getId();
+	newHeader.end = chain.end->getId();
+
+	// Size the context arrays. Slot counts are a power of two at least twice the number of
+	// contexts, as in NGramTable, so probe sequences stay short.
+	const NGramTable* chainGrams[2] = {&chain.postfixGrams, &chain.prefixGrams};
+	unsigned int* contextCounts[2] = {&newHeader.postfixContextCount, &newHeader.prefixContextCount};
+	unsigned int* slotCounts[2] = {&newHeader.postfixSlotCount, &newHeader.prefixSlotCount};
+
+	for(int t = 0; t < 2 && chain.order > 1; t++)
+	{
+		*contextCounts[t] = chainGrams[t]->size();
+
+		if(*contextCounts[t] > 0)
+		{
+			*slotCounts[t] = 16;
+			while(*slotCounts[t] < 2 * *contextCounts[t])
+				*slotCounts[t] *= 2;
+		}
+	}
+
+	// Split the words and each direction's contexts into one share per thread, weighed by
+	// their links
+	vector<unsigned int> bounds[3];
+	vector<size_t> weights(newHeader.wordCount);
+
+	for(unsigned int index = 0; index < weights.size(); index++)
+		weights[index] = chain.words[index]->getLinks().size();
+	splitShares(weights, threadCount, bounds[0]);
+
+	for(int t = 0; t < 2; t++)
+	{
+		weights.resize(*contextCounts[t]);
+		for(unsigned int c = 0; c < *contextCounts[t]; c++)
+			weights[c] = chainGrams[t]->getEdges(c).size();
+		splitShares(weights, threadCount, bounds[1 + t]);
+	}
+
+	// Encode the links of every word and context before the image is allocated, since the size
+	// of packed links isn't known until they're encoded. The offsets of plain links count edges.
+	size_t unit = (edgeFormat == FROZEN_EDGES_PLAIN) ? sizeof(FrozenEdge) : 1;
+	vector<FrozenShare> shares[4];
+	for(int t = 0; t < 4; t++)
+		shares[t].resize(threadCount);
+
+	auto encode = [&](int share)
+	{
+		vector<FrozenEdge> links[2];
+
+		for(int t = 0; t < 4; t++)
+			shares[t][share].edgeCount = 0;
+
+		// Each link of a word is split into its two directions, keeping only those with a count
+		for(unsigned int index = bounds[0][share]; index < bounds[0][share + 1]; index++)
+		{
+			const WordLinks& wordLinks = chain.words[index]->getLinks();
+			links[0].clear();
+			links[1].clear();
+
+			for(auto j = wordLinks.begin(); j != wordLinks.end(); j++)
+			{
+				unsigned int target = j->first;
+
+				if(j->second.postfixOccurrences > 0)
+					links[0].push_back({target, (unsigned int)j->second.postfixOccurrences});
+				if(j->second.prefixOccurrences > 0)
+					links[1].push_back({target, (unsigned int)j->second.prefixOccurrences});
+			}
+
+			for(int t = 0; t < 2; t++)
+			{
+				FrozenShare& out = shares[t][share];
+				out.offsets.push_back(out.bytes.size() / unit);
+				appendEdges(links[t], edgeFormat, out.bytes);
+				out.edgeCount += links[t].size();
+			}
+		}
+
+		for(int t = 0; t < 2; t++)
+		{
+			FrozenShare& out = shares[2 + t][share];
+
+			for(unsigned int c = bounds[1 + t][share]; c < bounds[1 + t][share + 1]; c++)
+			{
+				const vector<NGramEdge>& edges = chainGrams[t]->getEdges(c);
+				links[0].clear();
+
+				for(unsigned int j = 0; j < edges.size(); j++)
+					links[0].push_back({(unsigned int)edges[j].word, (unsigned int)edges[j].count});
+
+				out.offsets.push_back(out.bytes.size() / unit);
+				appendEdges(links[0], edgeFormat, out.bytes);
+				out.edgeCount += links[0].size();
+			}
+		}
+	};
+
+	vector<thread> threads;
+	for(int i = 1; i < threadCount; i++)
+		threads.push_back(thread(encode, i));
+
+	encode(0);
+
+	for(unsigned int i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	unsigned int* edgeCounts[4] = {&newHeader.postfixEdgeCount, &newHeader.prefixEdgeCount, &newHeader.postfixContextEdgeCount, &newHeader.prefixContextEdgeCount};
+	unsigned int* edgeSizes[4] = {&newHeader.postfixEdgeSize, &newHeader.prefixEdgeSize, &newHeader.postfixContextEdgeSize, &newHeader.prefixContextEdgeSize};
+
+	for(int t = 0; t < 4; t++)
+	{
+		for(int i = 0; i < threadCount; i++)
+		{
+			*edgeCounts[t] += shares[t][i].edgeCount;
+			*edgeSizes[t] += shares[t][i].bytes.size();
+		}
+	}
+
+	size_t offsets[FROZEN_SECTIONS];
+	size_t size = layout(newHeader, offsets);
+	buffer.assign(size, 0);
+
+	char* image = &buffer[0];
+	unsigned int* newTextOffsets = (unsigned int*)(image + offsets[0]);
+	unsigned int* newOccurrences = (unsigned int*)(image + offsets[1]);
+	char* newText = image + offsets[14];
+	unsigned int* newTextOrder = (unsigned int*)(image + offsets[15]);
+
+	unsigned int textSize = 0;
+	unsigned int index = 0;
+
+	// Copy the text of each word and the number of times it occurred
+	for(; index < newHeader.wordCount; index++)
+	{
+		Word* word = chain.words[index];
+		string_view wordText = word->getText();
+
+		newTextOffsets[index] = textSize;
+		memcpy(newText + textSize, wordText.data(), wordText.length());
+		textSize += wordText.length();
+
+		newOccurrences[index] = word->getOccurrences();
+	}
+	newTextOffsets[index] = textSize;
+
+	copy(sorted.begin(), sorted.end(), newTextOrder);
+
+	// Copy the encoded links and their offsets into their sections. The word sections come
+	// first, then the offsets and links of each direction's contexts.
+	int offsetSections[4] = {2, 3, 7, 11};
+	int edgeSections[4] = {4, 5, 8, 12};
+
+	for(int t = 0; t < 4; t++)
+	{
+		unsigned int* sectionOffsets = (unsigned int*)(image + offsets[offsetSections[t]]);
+		char* sectionEdges = image + offsets[edgeSections[t]];
+		size_t base = 0;
+
+		for(int i = 0; i < threadCount; i++)
+		{
+			const FrozenShare& share = shares[t][i];
+
+			for(unsigned int j = 0; j < share.offsets.size(); j++)
+				*sectionOffsets++ = share.offsets[j] + base / unit;
+
+			if(!share.bytes.empty())
+				memcpy(sectionEdges + base, &share.bytes[0], share.bytes.size());
+			base += share.bytes.size();
+		}
+
+		*sectionOffsets = base / unit;
+	}
+
+	// Copy the context keys in the order the chain numbered them, and hash each context into
+	// the slots
+	size_t order = newHeader.order;
+	for(int t = 0; t < 2; t++)
+	{
+		unsigned int* keys = (unsigned int*)(image + offsets[6 + 4 * t]);
+		unsigned int* slots = (unsigned int*)(image + offsets[9 + 4 * t]);
+		unsigned int slotMask = *slotCounts[t] - 1;
+
+		fill(slots, slots + *slotCounts[t], FROZEN_NONE);
+
+		for(unsigned int c = 0; c < *contextCounts[t]; c++)
+		{
+			const WordId* context = chainGrams[t]->getContext(c);
+			for(size_t j = 0; j < order; j++)
+				keys[c * order + j] = context[j];
+
+			unsigned int slot = NGramTable::hash((const WordId*)&keys[c * order], order) & slotMask;
+			while(slots[slot] != FROZEN_NONE)
+				slot = (slot + 1) & slotMask;
+			slots[slot] = c;
+		}
+	}
+
+	newHeader.checksum = checksum(image + offsets[0], size - offsets[0], threadCount);
+	memcpy(image, &newHeader, sizeof(newHeader));
+
+	attach(image, size);
+}
+
+
+// Replaces the contents of this snapshot with the image in the given file. The file is mapped
+// rather than read where the platform allows, so only the pages generation touches are ever
+// read from disk. Verifying the checksum reads the whole file, so it can be skipped for files
+// known to be good. Returns false, leaving the snapshot as it was, if the file is missing,
+// is not a chain image or fails verification.
+bool FrozenChain::load(string fileName, bool verify)
+{
+	return load(fileName, verify, 1);
+}
+
+
+// Loads the image in the given file as load(string, bool) does, verifying the checksum on the
+// given number of threads
+bool FrozenChain::load(string fileName, bool verify, int threadCount)
+{
+	FrozenChain loaded;
+
+#ifndef _WIN32
+	int file = open(fileName.c_str(), O_RDONLY);
+	if(file < 0)
+		return false;
+
+	struct stat info;
+	if(fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		close(file);
+		return false;
+	}
+
+	void* pages = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+
+	if(pages == MAP_FAILED)
+		return false;
+
+	loaded.mapping = pages;
+	loaded.mappingSize = info.st_size;
+
+	const char* image = (const char*)pages;
+	size_t size = info.st_size;
+#else
+	ifstream chainFile(fileName.c_str(), ios::in | ios::binary);
+	if(!chainFile.is_open())
+		return false;
+
+	chainFile.seekg(0, ios::end);
+	size_t size = (size_t)chainFile.tellg();
+	chainFile.seekg(0, ios::beg);
+
+	if(size == 0)
+		return false;
+
+	loaded.buffer.resize(size);
+	if(!chainFile.read(&loaded.buffer[0], size))
+		return false;
+
+	const char* image = &loaded.buffer[0];
+#endif
+
+	if(!loaded.attach(image, size))
+		return false;
+
+	if(verify)
+	{
+		size_t offset = (const char*)loaded.textOffsets - image;
+		if(checksum(image + offset, size - offset, threadCount) != loaded.header->checksum)
+			return false;
+	}
+
+	*this = std::move(loaded);
+	return true;
+}
+
+
+// Writes the image to the given file. Returns false if the file could not be written
+bool FrozenChain::save(string fileName)
+{
+	if(header == NULL)
+		return false;
+
+	ofstream saveFile(fileName.c_str(), ios::out | ios::trunc | ios::binary);
+	if(!saveFile.is_open())
+		return false;
+
+	saveFile.write((const char*)header, imageSize);
+	saveFile.close();
+
+	return !saveFile.fail();
+}
+
+
+// Generates a semi-random string from the snapshot using the calling thread's random engine,
+// or an engine seeded with the snapshot's seed
+string FrozenChain::generateString(int direction, unsigned int seed, int maxWordCount) const
+{
+	Random engine;
+	return generateString(direction, seed, maxWordCount, getEngine(engine));
+}
+
+
+// Generates a semi-random string from the snapshot, in the same manner as
+// MarkovChain::generateString. The seed is the index of a word. A snapshot never changes,
+// so any number of threads may generate from it at once, each with its own engine.
+string FrozenChain::generateString(int direction, unsigned int seed, int maxWordCount, Random& random) const
+{
+	if(header == NULL)
+		return string();
+
+	GenerationBuffer& buffer = GenerationBuffer::local();
+	buffer.clear();
+	appendString(direction, seed, maxWordCount, buffer, random);
+
+	return string(buffer.getString(0));
+}
+
+
+// Generates a semi-random sentence around a random word of the seed using the calling
+// thread's random engine, or an engine seeded with the snapshot's seed
+string FrozenChain::generateString(string seed, int maxWordCount) const
+{
+	Random engine;
+	return generateString(seed, maxWordCount, getEngine(engine));
+}
+
+
+// Generates a semi-random sentence around a random word of the seed, in the same manner
+// as MarkovChain::generateString
+string FrozenChain::generateString(string seed, int maxWordCount, Random& random) const
+{
+	if(header == NULL)
+		return string();
+
+	return generateString(GENERATE_BOTH, findSeed(seed, random), maxWordCount, random);
+}
+
+
+// Generates a semi-random sentence beginning with the start word using the calling
+// thread's random engine, or an engine seeded with the snapshot's seed
+string FrozenChain::generateString(int maxWordCount) const
+{
+	Random engine;
+	return generateString(GENERATE_POSTFIX, start, maxWordCount, getEngine(engine));
+}
+
+
+// Generates a semi-random sentence beginning with the start word
+string FrozenChain::generateString(int maxWordCount, Random& random) const
+{
+	return generateString(GENERATE_POSTFIX, start, maxWordCount, random);
+}
+
+
+// Generates the given number of semi-random sentences, each beginning with the start
+// word, and adds them to the end of the buffer. Uses the calling thread's random engine, or
+// an engine seeded with the snapshot's seed.
+void FrozenChain::generateBatch(int count, int maxWordCount, GenerationBuffer& buffer) const
+{
+	Random engine;
+	generateBatch(count, maxWordCount, buffer, getEngine(engine));
+}
+
+
+// Generates the given number of semi-random sentences into the buffer, drawing every
+// random choice from the given engine, in the same manner as MarkovChain::generateBatch
+void FrozenChain::generateBatch(int count, int maxWordCount, GenerationBuffer& buffer, Random& random) const
+{
+	if(header == NULL)
+		return;
+
+	for(int i = 0; i < count; i++)
+		appendString(GENERATE_POSTFIX, start, maxWordCount, buffer, random);
+}
+
+
+// Makes generation without an engine reproducible, as MarkovChain::setSeed does. A snapshot
+// starts with the seed of the chain it was built from, counting its calls from 0.
+void FrozenChain::setSeed(unsigned long long seed)
+{
+	seeded = true;
+	generationSeed = seed;
+	seededCalls = 0;
+}
+
+
+// Goes back to generating from each calling thread's own engine when none is given
+void FrozenChain::clearSeed()
+{
+	seeded = false;
+}
+
+
+// Returns the probability the snapshot gives the given text, as MarkovChain::scoreSentence does
+SentenceScore FrozenChain::scoreSentence(string_view text) const
+{
+	return scoreSentence(text, 0);
+}
+
+
+// Returns the probability the snapshot gives the given text with add-k smoothing, as
+// MarkovChain::scoreSentence does
+SentenceScore FrozenChain::scoreSentence(string_view text, double smoothing) const
+{
+	SentenceScore score;
+
+	if(header != NULL)
+		scoreText(text, smoothing, score);
+
+	score.finish();
+	return score;
+}
+
+
+// Scores each of the given texts without smoothing on the given number of threads, replacing
+// the contents of scores with their scores in the same order
+void FrozenChain::scoreMany(const vector<string_view>& texts, int threadCount, vector<SentenceScore>& scores) const
+{
+	scoreMany(texts, 0, threadCount, scores);
+}
+
+
+// Scores each of the given texts with add-k smoothing on the given number of threads. The
+// texts are split into runs of about the same number, and each thread scores one run into
+// its own part of scores with a buffer of its own, so the threads share nothing they write.
+void FrozenChain::scoreMany(const vector<string_view>& texts, double smoothing, int threadCount, vector<SentenceScore>& scores) const
+{
+	scores.assign(texts.size(), SentenceScore());
+
+	if(header == NULL)
+		return;
+
+	if(threadCount < 1 || texts.size() < (size_t)threadCount)
+		threadCount = 1;
+
+	auto scoreRun = [&](int run)
+	{
+		size_t first = texts.size() * run / threadCount;
+		size_t last = texts.size() * (run + 1) / threadCount;
+
+		for(size_t i = first; i < last; i++)
+		{
+			scoreText(texts[i], smoothing, scores[i]);
+			scores[i].finish();
+		}
+	};
+
+	vector<thread> threads;
+	for(int i = 1; i < threadCount; i++)
+		threads.push_back(thread(scoreRun, i));
+
+	scoreRun(0);
+
+	for(unsigned int i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+
+// Returns the index of the word with the given text, or FROZEN_NONE if there is none
+unsigned int FrozenChain::findWord(string_view word) const
+{
+	unsigned int low = 0;
+	unsigned int high = getWordCount();
+
+	// Binary search the words in order of their text
+	while(low < high)
+	{
+		unsigned int middle = low + (high - low) / 2;
+		unsigned int index = textOrder[middle];
+		unsigned int length = textOffsets[index + 1] - textOffsets[index];
+		int comparison = memcmp(text + textOffsets[index], word.data(), min<size_t>(length, word.length()));
+
+		if(comparison == 0)
+		{
+			if(length == word.length())
+				return index;
+
+			comparison = length < word.length() ? -1 : 1;
+		}
+
+		if(comparison < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return FROZEN_NONE;
+}
+
+
+// Returns the text of the word at the given index
+string FrozenChain::getText(unsigned int word) const
+{
+	return string(text + textOffsets[word], text + textOffsets[word + 1]);
+}
+
+
+// Returns the number of times the word at the given index occurred
+unsigned int FrozenChain::getOccurrences(unsigned int word) const
+{
+	return occurrences[word];
+}
+
+
+// Randomly chooses the index of a word found to follow the given word using the calling
+// thread's random engine
+unsigned int FrozenChain::getRandomPostfix(unsigned int word) const
+{
+	return sample(postfixOffsets, postfixEdges, word, Random::local());
+}
+
+
+// Randomly chooses the index of a word found to follow the given word, weighted by frequency
+unsigned int FrozenChain::getRandomPostfix(unsigned int word, Random& random) const
+{
+	return sample(postfixOffsets, postfixEdges, word, random);
+}
+
+
+// Randomly chooses the index of a word found to precede the given word using the calling
+// thread's random engine
+unsigned int FrozenChain::getRandomPrefix(unsigned int word) const
+{
+	return sample(prefixOffsets, prefixEdges, word, Random::local());
+}
+
+
+// Randomly chooses the index of a word found to precede the given word, weighted by frequency
+unsigned int FrozenChain::getRandomPrefix(unsigned int word, Random& random) const
+{
+	return sample(prefixOffsets, prefixEdges, word, random);
+}
+
+
+// Returns the number of words, including start and end
+unsigned int FrozenChain::getWordCount() const
+{
+	return header == NULL ? 0 : header->wordCount;
+}
+
+
+// Returns the number of links in both directions
+unsigned int FrozenChain::getEdgeCount() const
+{
+	return header == NULL ? 0 : header->postfixEdgeCount + header->prefixEdgeCount;
+}
+
+
+// Returns the format the links are stored in, FROZEN_EDGES_PLAIN or FROZEN_EDGES_PACKED
+int FrozenChain::getEdgeFormat() const
+{
+	return header == NULL ? FROZEN_EDGES_PLAIN : header->edgeFormat;
+}
+
+
+// Returns the size of the image in bytes. For a mapped image this is address space, of
+// which only the pages that have been touched take up memory.
+size_t FrozenChain::getMemoryUsage() const
+{
+	return imageSize;
+}
@@ -0,0 +1,250 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * FrozenChain.h: Declaration of the FrozenChain class. A compact, read-only copy of a MarkovChain.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FROZEN_CHAIN_H
+#define FROZEN_CHAIN_H
+
+#include "Random.h"
+#include "SentenceScore.h"
+#include <vector>
+#include <string>
+#include <string_view>
+#include <atomic>
+
+class MarkovChain;
+class GenerationBuffer;
+
+using namespace std;
+
+// Returned in place of a word index when there is no such word
+#define FROZEN_NONE 0xFFFFFFFFu
+
+// The version of the chain file layout written by FrozenChain::save
+#define FROZEN_VERSION 4
+
+// How the links of a frozen chain are stored. Plain links are FrozenEdges, found by binary
+// search. Packed links are variable-length numbers, several times smaller but decoded in order.
+#define FROZEN_EDGES_PLAIN 0
+#define FROZEN_EDGES_PACKED 1
+
+// The number of packed links between the restart points a packed list can be entered at
+#define FROZEN_BLOCK_SIZE 32
+
+// One link of a frozen word. The target is the index of the linked word, and cumulative is
+// the sum of the counts of this link and every link before it in the same word's list
+struct FrozenEdge
+{
+	unsigned int target;
+	unsigned int cumulative;
+};
+
+// The fixed-size block at the start of a chain image. The sizes in it determine where
+// each of the arrays that follow it begin.
+struct FrozenHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned int order;
+	unsigned int edgeFormat;
+	unsigned int wordCount;
+	unsigned int start;
+	unsigned int end;
+	unsigned int textSize;
+	unsigned int postfixEdgeCount;
+	unsigned int prefixEdgeCount;
+
+	// The sizes of the context arrays of each direction, all zero for a chain of order 1
+	unsigned int postfixContextCount;
+	unsigned int postfixContextEdgeCount;
+	unsigned int postfixSlotCount;
+	unsigned int prefixContextCount;
+	unsigned int prefixContextEdgeCount;
+	unsigned int prefixSlotCount;
+
+	// The size in bytes of the links of each direction, and of each direction's contexts
+	unsigned int postfixEdgeSize;
+	unsigned int prefixEdgeSize;
+	unsigned int postfixContextEdgeSize;
+	unsigned int prefixContextEdgeSize;
+
+	// Checksum of everything in the image after the header
+	unsigned int checksum;
+};
+
+// The contexts of one direction of a frozen chain of order k. The key of context c is the
+// k word indices starting at keys[c * k], and the words seen next to it are the links between
+// offsets[c] and offsets[c + 1] of edges, stored as the chain's links are. Slots is an
+// open-addressing hash table of context numbers, hashed as NGramTable hashes them, with
+// FROZEN_NONE in the empty slots.
+struct FrozenContexts
+{
+	unsigned int count;
+	unsigned int slotCount;
+	const unsigned int* keys;
+	const unsigned int* offsets;
+	const char* edges;
+	const unsigned int* slots;
+};
+
+// A read-only snapshot of a MarkovChain, laid out in contiguous arrays. Words are numbered
+// 0..n-1 by the ids their chain gave them, and listed again in order of their text so they can
+// be found by it. The links of word i in each direction are the edges between
+// offsets[i] and offsets[i + 1], so generation is an array walk and a binary search per word
+// instead of a pointer chase through a tree. The snapshot does not change when the chain
+// it was made from does.
+//
+// Each list of links is sorted by target. Plain lists are FrozenEdges and their offsets count
+// edges. Packed lists are bytes and their offsets count bytes: the number of links and their
+// total count as variable-length numbers, then for every FROZEN_BLOCK_SIZE links after the
+// first block the running total before the block and the offset of its first link from the
+// first link of the list, as pairs of unsigned ints, and then each link as the difference
+// between its target and the one before it in its block and its count, as variable-length
+// numbers. The first link of each block stores its whole target, so sampling can binary
+// search the blocks and decode only one of them.
+//
+// All of the arrays live in a single image: a FrozenHeader followed by each array, aligned
+// to 8 bytes, in the order of the members below, with each direction's contexts in the
+// order of the FrozenContexts members. The image is exactly what save writes to disk, so
+// load can map a file and generate from its pages without parsing or copying it. Numbers
+// are stored in the byte order of the machine that saved them.
+class FrozenChain
+{
+	friend class MarkovChain;
+	friend class CheckpointLog;
+
+private:
+	// The image when it was built or read into memory. Empty when the image is mapped.
+	vector<char> buffer;
+
+	// The image when it is mapped from a file
+	void* mapping;
+	size_t mappingSize;
+
+	// The start and size of the image, whichever of the above holds it
+	const FrozenHeader* header;
+	size_t imageSize;
+
+	// The beginning of the text of each word, plus one past the end of the last
+	const unsigned int* textOffsets;
+
+	// The number of times each word occurred in the corpus
+	const unsigned int* occurrences;
+
+	// The beginning of each word's links in each direction, plus one past the end of the last
+	const unsigned int* postfixOffsets;
+	const unsigned int* prefixOffsets;
+
+	// Links to the words that follow and precede each word, in the format of the header
+	const char* postfixEdges;
+	const char* prefixEdges;
+
+	// For an order above 1, the words seen after and before each run of words
+	FrozenContexts postfixGrams;
+	FrozenContexts prefixGrams;
+
+	// The text of every word, back to back
+	const char* text;
+
+	// The index of every word, in order of the words' text
+	const unsigned int* textOrder;
+
+	// Indices of the start and end words
+	unsigned int start;
+	unsigned int end;
+
+	// Whether generation without an engine of the caller's draws from a new engine seeded with
+	// generationSeed and the number of such calls made since, as a seeded MarkovChain's does.
+	// These are settings of the snapshot rather than part of its image, and a new snapshot
+	// counts its calls from 0. The links are sampled in order of target, as the chain samples
+	// them in SAMPLE_CUMULATIVE mode, so a snapshot's calls give the strings its chain's calls
+	// give after setSeed with the default generation policy, whether it was built, read or mapped.
+	bool seeded;
+	unsigned long long generationSeed;
+	mutable atomic<unsigned long long> seededCalls;
+
+	static size_t layout(const FrozenHeader&, size_t*);
+	static void sumWords(const char*, size_t, unsigned long long&, unsigned long long&);
+	static unsigned int checksum(const char*, size_t);
+	static unsigned int checksum(const char*, size_t, int);
+	static void splitShares(const vector<size_t>&, int, vector<unsigned int>&);
+	static void appendEdges(vector<FrozenEdge>&, int, vector<char>&);
+
+	bool attach(const char*, size_t);
+	void release();
+	unsigned int sample(const unsigned int*, const char*, unsigned int, Random&) const;
+	unsigned int samplePacked(const unsigned char*, const unsigned char*, Random&) const;
+	void getEdges(const unsigned int*, const char*, unsigned int, vector<FrozenEdge>&) const;
+	unsigned int findContext(const FrozenContexts&, const unsigned int*) const;
+	unsigned int getLinkCount(const unsigned int*, const char*, unsigned int, unsigned int, unsigned int&) const;
+	void scoreText(string_view, double, SentenceScore&) const;
+	unsigned int findSeed(string_view, Random&) const;
+	unsigned int getRandomNext(int, unsigned int, bool, GenerationBuffer&, Random&) const;
+	void appendString(int, unsigned int, int, GenerationBuffer&, Random&) const;
+	Random& getEngine(Random&) const;
+
+	// Snapshots hold pointers into their own image, so they are moved rather than copied
+	FrozenChain(const FrozenChain&);
+	FrozenChain& operator=(const FrozenChain&);
+
+public:
+	FrozenChain();
+	FrozenChain(const MarkovChain&);
+	FrozenChain(const MarkovChain&, int);
+	FrozenChain(const MarkovChain&, int, int);
+	FrozenChain(FrozenChain&&);
+	FrozenChain& operator=(FrozenChain&&);
+	~FrozenChain();
+
+	void build(const MarkovChain&);
+	void build(const MarkovChain&, int);
+	void build(const MarkovChain&, int, int);
+	bool load(string, bool);
+	bool load(string, bool, int);
+	bool save(string);
+
+	string generateString(int, unsigned int, int) const;
+	string generateString(int, unsigned int, int, Random&) const;
+	string generateString(string, int) const;
+	string generateString(string, int, Random&) const;
+	string generateString(int) const;
+	string generateString(int, Random&) const;
+	void generateBatch(int, int, GenerationBuffer&) const;
+	void generateBatch(int, int, GenerationBuffer&, Random&) const;
+	void setSeed(unsigned long long);
+	void clearSeed();
+	SentenceScore scoreSentence(string_view) const;
+	SentenceScore scoreSentence(string_view, double) const;
+	void scoreMany(const vector<string_view>&, int, vector<SentenceScore>&) const;
+	void scoreMany(const vector<string_view>&, double, int, vector<SentenceScore>&) const;
+
+	unsigned int findWord(string_view) const;
+	string getText(unsigned int) const;
+	unsigned int getOccurrences(unsigned int) const;
+	unsigned int getRandomPostfix(unsigned int) const;
+	unsigned int getRandomPostfix(unsigned int, Random&) const;
+	unsigned int getRandomPrefix(unsigned int) const;
+	unsigned int getRandomPrefix(unsigned int, Random&) const;
+
+	unsigned int getWordCount() const;
+	unsigned int getEdgeCount() const;
+	int getEdgeFormat() const;
+	size_t getMemoryUsage() const;
+};
+
+#endif
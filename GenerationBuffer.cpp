@@ -0,0 +1,211 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * GenerationBuffer.cpp: Definition of the GenerationBuffer class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GenerationBuffer.h"
+#include "MarkovChain.h"
+#include <algorithm>
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Private Static Members -----------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Returns the calling thread's own buffer, which generateString writes each string into
+// before copying it out, so that generating one string allocates only the string itself
+GenerationBuffer& GenerationBuffer::local()
+{
+	thread_local GenerationBuffer buffer;
+
+	return buffer;
+}
+
+
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
+
+
+// Empties the ring for a string of at most the given number of words besides the seed, so
+// that generating it never has to grow the ring
+void GenerationBuffer::startString(int maxWordCount)
+{
+	unsigned int needed = min(max(maxWordCount, 0), GENERATION_RING_SIZE) + 1;
+
+	if(ring.size() < needed)
+	{
+		unsigned int size = 16;
+		while(size < needed)
+			size *= 2;
+
+		ring.resize(size);
+	}
+
+	ringFirst = 0;
+	wordCount = 0;
+}
+
+
+// Doubles the size of a full ring, moving its words to the start of the new one
+void GenerationBuffer::growRing()
+{
+	vector<unsigned int> grown(ring.size() * 2);
+	for(unsigned int i = 0; i < wordCount; i++)
+		grown[i] = getWord(i);
+
+	ring.swap(grown);
+	ringFirst = 0;
+}
+
+
+// Adds a word to the beginning of the string
+void GenerationBuffer::pushFront(unsigned int word)
+{
+	if(wordCount == ring.size())
+		growRing();
+
+	ringFirst = (ringFirst - 1) & (ring.size() - 1);
+	ring[ringFirst] = word;
+	wordCount++;
+}
+
+
+// Adds a word to the end of the string
+void GenerationBuffer::pushBack(unsigned int word)
+{
+	if(wordCount == ring.size())
+		growRing();
+
+	ring[(ringFirst + wordCount) & (ring.size() - 1)] = word;
+	wordCount++;
+}
+
+
+// Returns the word at the given position in the string
+unsigned int GenerationBuffer::getWord(unsigned int index) const
+{
+	return ring[(ringFirst + index) & (ring.size() - 1)];
+}
+
+
+// Lengthens the text by the given number of bytes, all at once, and returns where they begin
+char* GenerationBuffer::extendText(size_t size)
+{
+	size_t length = text.length();
+	text.resize(length + size);
+
+	return &text[length];
+}
+
+
+// Ends the string currently being written. Everything written since the last string
+// ended becomes the next string.
+void GenerationBuffer::finishString()
+{
+	offsets.push_back(text.length());
+}
+
+
+// Fills context with the order words of the string being generated that are nearest its
+// end in the given direction, in the order they appear in the string: the last words for
+// GENERATE_POSTFIX and the first for GENERATE_PREFIX. If the string has fewer than order
+// words, the context is padded with the terminator when that end of the string is known to
+// be terminated, and false is returned when it isn't, since the words that belong there
+// aren't known yet.
+bool GenerationBuffer::getContext(int direction, bool terminated, unsigned int terminator, int order, unsigned int* context) const
+{
+	int length = wordCount;
+
+	if(length < order && !terminated)
+		return false;
+
+	// The index in the string of the first word of the context. Negative indices are padding
+	int first = (direction == GENERATE_POSTFIX) ? length - order : 0;
+
+	for(int i = 0; i < order; i++)
+	{
+		int j = first + i;
+
+		if(j < 0 || j >= length)
+			context[i] = terminator;
+		else
+			context[i] = getWord(j);
+	}
+
+	return true;
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty buffer
+GenerationBuffer::GenerationBuffer()
+{
+	offsets.push_back(0);
+	ringFirst = 0;
+	wordCount = 0;
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Removes every string but keeps the memory, so the next batch can reuse it
+void GenerationBuffer::clear()
+{
+	text.clear();
+	offsets.resize(1);
+	ringFirst = 0;
+	wordCount = 0;
+}
+
+
+// Makes room for the given number of strings and bytes of text, so that a batch of that
+// size allocates nothing while it generates
+void GenerationBuffer::reserve(unsigned int stringCount, size_t textSize)
+{
+	offsets.reserve(stringCount + 1);
+	text.reserve(textSize);
+}
+
+
+// Returns the number of strings in the buffer
+unsigned int GenerationBuffer::size() const
+{
+	return offsets.size() - 1;
+}
+
+
+// Returns the string at the given index. It stays valid until the buffer is cleared or
+// more strings are generated into it.
+string_view GenerationBuffer::getString(unsigned int index) const
+{
+	return string_view(text.data() + offsets[index], offsets[index + 1] - offsets[index]);
+}
+
+
+// Returns the text of every string in the buffer, back to back
+const string& GenerationBuffer::getText() const
+{
+	return text;
+}
@@ -0,0 +1,111 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * GenerationBuffer.h: Declaration of the GenerationBuffer class. Holds the strings made by a batch of generation.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERATION_BUFFER_H
+#define GENERATION_BUFFER_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// The most words a string's ring is sized for before generation starts. A ring only grows
+// past this for strings that turn out to be longer.
+#define GENERATION_RING_SIZE 4096
+
+// One partial string of a beam search: the word it ends with, the partial string it grew
+// from, by index, or -1 for the seed, and the log of its probability
+struct BeamNode
+{
+	int parent;
+	unsigned int word;
+	double score;
+};
+
+// The output of generateBatch. Every generated string is written back to back into one
+// block of text, and the offsets mark where each one begins. Clearing the buffer keeps
+// the memory it has grown to, so once a buffer has held a batch as large as the next one,
+// generating into it again allocates nothing.
+class GenerationBuffer
+{
+	friend class MarkovChain;
+	friend class FrozenChain;
+
+private:
+	// The text of every string, back to back. Each word is followed by a space, as in generateString
+	string text;
+
+	// The beginning of each string in text, plus one past the end of the last
+	vector<size_t> offsets;
+
+	// The ids of the words of the string being generated, in a ring that grows at both ends.
+	// The string is the wordCount words starting at ringFirst, wrapping around past the end of
+	// the ring, whose size is a power of two. They're written out as text once both ends of
+	// the string have been found.
+	vector<unsigned int> ring;
+	unsigned int ringFirst;
+	unsigned int wordCount;
+
+	// The context of the next word, for chains of an order above 1
+	vector<unsigned int> context;
+
+	// The counts of the words a generation policy chooses among, most common first, and their
+	// running totals
+	vector<int> rankCounts;
+	vector<int> rankTotals;
+
+	// Every partial string of a beam search, the ones kept at the last step and the ones
+	// grown from them, by index
+	vector<BeamNode> beamNodes;
+	vector<int> beam;
+	vector<int> beamGrown;
+
+	// The words of a seed being resolved, the id each of them was found with and the
+	// lower case form of one of them
+	vector<string_view> seedWords;
+	vector<unsigned int> seedIds;
+	string foldedWord;
+
+	// The end of each sentence of a text being scored, as an index into seedWords
+	vector<unsigned int> sentenceEnds;
+
+	static GenerationBuffer& local();
+
+	void startString(int);
+	void growRing();
+	void pushFront(unsigned int);
+	void pushBack(unsigned int);
+	unsigned int getWord(unsigned int) const;
+	char* extendText(size_t);
+	void finishString();
+	bool getContext(int, bool, unsigned int, int, unsigned int*) const;
+
+public:
+	GenerationBuffer();
+
+	void clear();
+	void reserve(unsigned int, size_t);
+
+	unsigned int size() const;
+	string_view getString(unsigned int) const;
+	const string& getText() const;
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * GenerationPolicy.cpp: Definition of the GenerationPolicy class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GenerationPolicy.h"
+#include <algorithm>
+#include <cmath>
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes the default policy, which draws from every word in proportion to its count
+GenerationPolicy::GenerationPolicy()
+{
+	topK = 0;
+	temperature = 1;
+	beamWidth = 0;
+}
+
+
+// Initializes a policy that draws from the given number of most common words, 0 meaning all
+// of them, with their counts raised to the power 1 / temperature
+GenerationPolicy::GenerationPolicy(int topK, double temperature)
+{
+	this->topK = max(topK, 0);
+	this->temperature = max(temperature, 0.0);
+	beamWidth = 0;
+}
+
+
+// Initializes a policy as above that finds each string by a beam search of the given width
+// instead, when the width is above 0
+GenerationPolicy::GenerationPolicy(int topK, double temperature, int beamWidth)
+{
+	this->topK = max(topK, 0);
+	this->temperature = max(temperature, 0.0);
+	this->beamWidth = max(beamWidth, 0);
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Returns whether the policy draws from every word in proportion to its count, which the
+// chain's own sampling tables do faster than choose can
+bool GenerationPolicy::isProportional() const
+{
+	return topK == 0 && temperature == 1 && beamWidth == 0;
+}
+
+
+// Chooses one of the given number of words by the policy and returns its rank. The words are
+// given by their counts from most to least common, and by the running totals of those counts.
+// Drawing in proportion to the counts searches the totals of the top k words. Any other
+// temperature weighs each of the top k words in turn, so it takes time in proportion to k, or
+// to the number of words when there's no top k. Returns -1 when there are no words.
+int GenerationPolicy::choose(const int* counts, const int* totals, int size, Random& random) const
+{
+	if(size <= 0)
+		return -1;
+
+	int candidates = (topK > 0 && topK < size) ? topK : size;
+	if(candidates == 1 || temperature <= 0)
+		return 0;
+
+	if(temperature == 1)
+	{
+		int r = random.nextInt(totals[candidates - 1]);
+		return upper_bound(totals, totals + candidates, r) - totals;
+	}
+
+	// Weigh the counts against the most common one, so that no power can overflow
+	double exponent = 1 / temperature;
+	double sum = 0;
+
+	for(int i = 0; i < candidates; i++)
+		sum += pow((double)counts[i] / counts[0], exponent);
+
+	double r = random.nextDouble() * sum;
+
+	for(int i = 0; i < candidates; i++)
+	{
+		r -= pow((double)counts[i] / counts[0], exponent);
+		if(r < 0)
+			return i;
+	}
+
+	// Rounding may leave a sliver of the sum past the last word
+	return candidates - 1;
+}
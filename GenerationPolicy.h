@@ -0,0 +1,60 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * GenerationPolicy.h: Declaration of the GenerationPolicy class. How generation chooses each next word.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERATION_POLICY_H
+#define GENERATION_POLICY_H
+
+#include "Random.h"
+
+using namespace std;
+
+// How a MarkovChain chooses among the words that may come next, set with
+// MarkovChain::setGenerationPolicy. The default draws each word in proportion to the number
+// of times it was seen there, as the chain always has.
+//
+// A top k of 1, or a temperature of 0, always takes the most common word, so the same seed
+// always gives the same string. Any other top k draws among only the k most common words. A
+// temperature raises each count to the power 1 / temperature before drawing, so a temperature
+// below 1 favors the common words even more and one above 1 evens the odds. Both may be set.
+//
+// A beam width above 0 doesn't draw at all. Each string is instead the most likely one the
+// chain can make from its seed to the end of a sentence within the most words, as found by a
+// beam search that keeps that many of the likeliest partial strings at each step.
+class GenerationPolicy
+{
+public:
+	// The number of most common words the next word is drawn from, or 0 for every word
+	int topK;
+
+	// Each count is raised to the power 1 / temperature before drawing. 1 leaves the counts as
+	// they are and 0 always takes the most common word
+	double temperature;
+
+	// The number of partial strings a beam search keeps, or 0 to draw every word instead
+	int beamWidth;
+
+	GenerationPolicy();
+	GenerationPolicy(int, double);
+	GenerationPolicy(int, double, int);
+
+	bool isProportional() const;
+	int choose(const int*, const int*, int, Random&) const;
+};
+
+#endif
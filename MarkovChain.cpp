@@ -19,7 +19,18 @@
 
 #include "MarkovChain.h"
 #include "Word.h"
-#include <list>
+#include "FrozenChain.h"
+#include "ChainShard.h"
+#include "GenerationBuffer.h"
+#include "Tokenizer.h"
+#include "CheckpointLog.h"
+#include "RankTable.h"
+#include <new>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <cmath>
 
 /*---------------------------------------------------------------------*/
 /*---------------------- Private Static Members -----------------------*/
@@ -33,547 +44,1909 @@ const char MarkovChain::endText[2] = {(char)0x12, '\0'};
 /*--------------------------------------------------------------*/
 
 
-// Reinitializes the start and end words with specific ids
-void MarkovChain::initTerminators(int startId, int endId)
+// Reinitializes the stand and end words. They are added before any other word, so they
+// always have the first two ids
+void MarkovChain::initTerminators()
+{
+	start = addWord(startText);
+	end = addWord(endText);
+}
+
+
+// Frees every Word and all of their links at once. Words are never destroyed one by one,
+// so only their sampling tables, which live outside the arena, need to be visited.
+void MarkovChain::release()
+{
+	for(unsigned int i = 0; i < words.size(); i++)
+		words[i]->discardTables();
+
+	vector<Word*>().swap(words);
+	arena.release();
+
+	for(unsigned int i = 0; i < shareArenas.size(); i++)
+		delete shareArenas[i];
+	vector<Arena*>().swap(shareArenas);
+}
+
+
+// Returns the Word with the given text, adding it to the dictionary if it's new
+Word* MarkovChain::addWord(string_view text)
+{
+	return addWord(text, &arena);
+}
+
+
+// Returns the Word with the given text, adding it to the dictionary if it's new. A new Word
+// keeps its links in the given arena.
+Word* MarkovChain::addWord(string_view text, Arena* linkArena)
+{
+	WordId id = dictionary.intern(text);
+
+	// A new id is always the next one, so the Word goes on the end
+	if(id == (WordId)words.size())
+	{
+		words.push_back(new(arena.allocate(sizeof(Word))) Word(dictionary.getText(id), id, this, linkArena));
+
+		if(caseFolding)
+			addFolded(id);
+	}
+
+	return words[id];
+}
+
+
+// Adds one tokenized sentence of the given number of words to the chain, linking each word
+// to the next, from start to end
+void MarkovChain::addSentence(const string_view* sentence, unsigned int length)
+{
+	// If there are no words in the sentence (elipses, for example), immediately
+	// skip to the next sentence
+	if(length == 0)
+		return;
+
+	// The current word in the sentence's sequence being analyzed. Initially
+	// set to the start word so that links to words commonly starting sentences
+	// can be found.
+	Word* word = start;
+
+	// In order to generate random words quickly, the number of times the word
+	// occurrs is needed. Since start never actually occurs, it must be set
+	// to occurr artificially.
+	word->addOccurrence();
+	sentenceIds.clear();
+
+	// Only words added as text count as new, not those rebuilt by loading or pruning
+#ifdef MARQOV_STATS
+	size_t knownWords = words.size();
+#endif
+
+	// Sentences are only kept for the log while there is one to write them to
+	bool recording = !checkpointName.empty();
+
+	// For each word in the sentence
+	for(unsigned int i = 0; i < length; i++)
+	{
+		// Another, probably unnecessary, check for empty words
+		if(sentence[i].length() == 0)
+			continue;
+
+		// Pull the Word object for the next textual word from the dictionary,
+		// adding it if it's not there yet
+		Word* nextWord = addWord(sentence[i]);
+
+		if(order > 1)
+			sentenceIds.push_back(nextWord->getId());
+
+		if(recording)
+			pendingSentences.push_back(nextWord->getId());
+
+		// Examining this word implies it has occurred again in the corpus.
+		// Increment its count of occurrences
+		nextWord->addOccurrence();
+
+		// The nextWord value comes after word in the sentence sequence, therefore
+		// nextWord is a postfix of word. Add it as such, so nextWord becomes
+		// a possiblity to follow word when generating the final string.
+		if(word->addPostfix(nextWord))
+			STATS_ADD(stats, STAT_NEW_LINKS, 1);
+		nextWord->addPrefix(word);
+
+		// The following word of the sequence comes after nextWord, so nextWord
+		// assumes the role of its predecessor
+		word = nextWord;
+	}
+
+	// Add the end to the final word in the sequence to mark it as a possible
+	// ending point for sentences (because by definition nothing follows end).
+	if(word != start)
+	{
+		if(word->addPostfix(end))
+			STATS_ADD(stats, STAT_NEW_LINKS, 1);
+		end->addPrefix(word);
+
+		if(recording)
+			pendingSentences.push_back(NO_WORD);
+	}
+
+	STATS_ADD(stats, STAT_NEW_WORDS, words.size() - knownWords);
+
+	// Count the runs of order words, and the words before and after each of them
+	if(order > 1)
+	{
+		postfixGrams.addSentence(sentenceIds, start->getId(), end->getId(), GENERATE_POSTFIX);
+		prefixGrams.addSentence(sentenceIds, start->getId(), end->getId(), GENERATE_PREFIX);
+	}
+}
+
+
+// Adds the sentences found by the Tokenizer, the words of sentence i running from
+// sentenceEnds[i - 1], or 0, up to sentenceEnds[i]
+void MarkovChain::addSentences(const vector<string_view>& words, const vector<unsigned int>& sentenceEnds)
+{
+	unsigned int begin = 0;
+
+	for(unsigned int i = 0; i < sentenceEnds.size(); i++)
+	{
+		addSentence(&words[begin], sentenceEnds[i] - begin);
+		begin = sentenceEnds[i];
+	}
+
+	STATS_ADD(stats, STAT_SENTENCES, sentenceEnds.size());
+	STATS_ADD(stats, STAT_TOKENS, begin);
+}
+
+
+// Stops keeping the sentences added for checkpoint, so that the next checkpoint rewrites the
+// whole chain file. Used whenever the chain changes in a way its log can't record.
+void MarkovChain::stopRecording()
+{
+	checkpointName.clear();
+	vector<WordId>().swap(pendingSentences);
+}
+
+
+// Adds the counts of the words, links and runs of words of the given image to the chain's,
+// creating the words the chain doesn't have. The image must have the chain's order.
+void MarkovChain::addImage(const FrozenChain& image)
 {
-	start = new Word(startText, startId, this);
-	end = new Word(endText, endId, this);
+	addImage(image, 1);
+}
+
+
+// Adds the counts of the given image to the chain's as addImage(image) does, on the given
+// number of threads. Every word's links are found through the image's offsets, so the words
+// are split into shares of about the same number of links, and each thread links the words
+// of one share. A thread only changes the words of its share that this call created, each of
+// which keeps its links in an arena of the share's own. The words the chain already had are
+// linked afterwards on the calling thread, while the runs of words are counted on threads of
+// their own, one per direction.
+void MarkovChain::addImage(const FrozenChain& image, int threadCount)
+{
+	if(threadCount < 1)
+		threadCount = 1;
+
+	unsigned int wordCount = image.getWordCount();
+	vector<Word*> imageWords(wordCount);
+	vector<bool> created(wordCount, false);
+
+	vector<size_t> weights(wordCount);
+	for(unsigned int i = 0; i < wordCount; i++)
+		weights[i] = (image.postfixOffsets[i + 1] - image.postfixOffsets[i]) + (image.prefixOffsets[i + 1] - image.prefixOffsets[i]);
+
+	vector<unsigned int> bounds;
+	FrozenChain::splitShares(weights, threadCount, bounds);
+
+	// Create the words first so that links can refer to any of them. The chain's own
+	// start and end are reused for the image's terminators.
+	for(int share = 0; share < threadCount; share++)
+	{
+		Arena* linkArena = &arena;
+		if(threadCount > 1)
+		{
+			linkArena = new Arena();
+			shareArenas.push_back(linkArena);
+		}
+
+		for(unsigned int i = bounds[share]; i < bounds[share + 1]; i++)
+		{
+			// A word left with no links by pruning is not recreated
+			if(weights[i] == 0 && i != image.start && i != image.end)
+				continue;
+
+			size_t wordsBefore = words.size();
+			imageWords[i] = addWord(image.getText(i), linkArena);
+			imageWords[i]->addOccurrences(image.getOccurrences(i));
+			created[i] = words.size() > wordsBefore;
+		}
+	}
+
+	// Turns the running totals of a word's links in one direction back into counts, and adds
+	// them to the word in order of the linked words' ids
+	auto linkWord = [&image, &imageWords](unsigned int i, int direction, vector<FrozenEdge>& edges, vector<pair<Word*, int> >& counts)
+	{
+		if(direction == GENERATE_POSTFIX)
+			image.getEdges(image.postfixOffsets, image.postfixEdges, i, edges);
+		else
+			image.getEdges(image.prefixOffsets, image.prefixEdges, i, edges);
+
+		counts.clear();
+
+		unsigned int total = 0;
+		for(unsigned int j = 0; j < edges.size(); j++)
+		{
+			counts.push_back(make_pair(imageWords[edges[j].target], (int)(edges[j].cumulative - total)));
+			total = edges[j].cumulative;
+		}
+
+		auto byId = [](const pair<Word*, int>& a, const pair<Word*, int>& b)
+		{
+			return a.first->getId() < b.first->getId();
+		};
+
+		if(!is_sorted(counts.begin(), counts.end(), byId))
+			sort(counts.begin(), counts.end(), byId);
+
+		imageWords[i]->addLinks(direction, counts);
+	};
+
+	// Link the new words of one share
+	auto linkShare = [&](int share)
+	{
+		vector<FrozenEdge> edges;
+		vector<pair<Word*, int> > counts;
+
+		for(unsigned int i = bounds[share]; i < bounds[share + 1]; i++)
+		{
+			if(!created[i])
+				continue;
+
+			linkWord(i, GENERATE_POSTFIX, edges, counts);
+			linkWord(i, GENERATE_PREFIX, edges, counts);
+		}
+	};
+
+	// Turn the running totals of each context's words back into counts, in the same order
+	const FrozenContexts* imageGrams[2] = {&image.postfixGrams, &image.prefixGrams};
+	NGramTable* chainGrams[2] = {&postfixGrams, &prefixGrams};
+
+	auto addGrams = [&](int t)
+	{
+		vector<FrozenEdge> edges;
+		vector<WordId> context(order);
+
+		for(unsigned int c = 0; c < imageGrams[t]->count; c++)
+		{
+			for(int j = 0; j < order; j++)
+				context[j] = imageWords[imageGrams[t]->keys[(size_t)c * order + j]]->getId();
+
+			image.getEdges(imageGrams[t]->offsets, imageGrams[t]->edges, c, edges);
+
+			unsigned int total = 0;
+			for(unsigned int j = 0; j < edges.size(); j++)
+			{
+				chainGrams[t]->add(&context[0], imageWords[edges[j].target]->getId(), edges[j].cumulative - total);
+				total = edges[j].cumulative;
+			}
+		}
+	};
+
+	vector<thread> threads;
+	if(threadCount > 1)
+	{
+		for(int share = 1; share < threadCount; share++)
+			threads.push_back(thread(linkShare, share));
+
+		for(int t = 0; t < 2; t++)
+			threads.push_back(thread(addGrams, t));
+	}
+
+	linkShare(0);
+
+	for(unsigned int i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	if(threadCount == 1)
+	{
+		addGrams(0);
+		addGrams(1);
+	}
+
+	// Link the words the chain already had, which any share may link to
+	vector<FrozenEdge> edges;
+	vector<pair<Word*, int> > counts;
+
+	for(unsigned int i = 0; i < wordCount; i++)
+	{
+		if(imageWords[i] == NULL || created[i])
+			continue;
+
+		linkWord(i, GENERATE_POSTFIX, edges, counts);
+		linkWord(i, GENERATE_PREFIX, edges, counts);
+	}
+}
+
+
+// Prunes the rarest links, doubling the count a link needs to be kept, until the chain is
+// back under MEMORY_BUDGET_TARGET percent of its budget or has no links left to prune
+void MarkovChain::enforceBudget()
+{
+	if(memoryBudget == 0 || getMemoryUsage() <= memoryBudget)
+		return;
+
+	size_t target = memoryBudget / 100 * MEMORY_BUDGET_TARGET;
+
+	for(int minCount = 2; getMemoryUsage() > target; minCount *= 2)
+	{
+		// No link is counted more often than its word's links are in total
+		int largest = 0;
+		for(unsigned int i = 0; i < words.size(); i++)
+			largest = max(largest, words[i]->getTotal(GENERATE_POSTFIX));
+
+		if(minCount > largest)
+			break;
+
+		prune(minCount, 0);
+	}
+}
+
+
+// Adds the counts gathered by a shard to the chain. Words the chain hasn't seen are created
+// in the order the shard first saw them, so merging shards in corpus order numbers the
+// words exactly as adding the same text sentence by sentence would.
+void MarkovChain::mergeShard(ChainShard& shard)
+{
+	vector<Word*> shardWords(shard.occurrences.size());
+	shardWords[SHARD_START] = start;
+	shardWords[SHARD_END] = end;
+
+#ifdef MARQOV_STATS
+	size_t knownWords = words.size();
+#endif
+
+	for(unsigned int i = SHARD_END + 1; i < shardWords.size(); i++)
+		shardWords[i] = addWord(shard.getText(i));
+
+	STATS_ADD(stats, STAT_NEW_WORDS, words.size() - knownWords);
+
+	for(unsigned int i = 0; i < shardWords.size(); i++)
+		shardWords[i]->addOccurrences(shard.occurrences[i]);
+
+	// Each transition is a postfix of its first word and a prefix of its second. Words sample
+	// their links in order of the linked words' ids, so the order the transitions are replayed
+	// in doesn't change what an engine draws.
+	for(unsigned int i = 0; i < shard.transitions.size(); i++)
+	{
+		const ShardTransition& transition = shard.transitions[i];
+		Word* word = shardWords[transition.word];
+		Word* nextWord = shardWords[transition.nextWord];
+
+		if(word->addPostfix(nextWord, transition.count))
+			STATS_ADD(stats, STAT_NEW_LINKS, 1);
+		nextWord->addPrefix(word, transition.count);
+	}
+
+	// Contexts and their words are visited in the order the shard first saw them, so they are
+	// numbered and kept in the order adding the text directly would have. Contexts sample their
+	// words in order of id and rank them by count and then id, so the counts alone decide what
+	// an engine draws.
+	NGramTable* shardGrams[2] = {&shard.postfixGrams, &shard.prefixGrams};
+	NGramTable* chainGrams[2] = {&postfixGrams, &prefixGrams};
+	vector<WordId> context(order);
+
+	for(int t = 0; t < 2; t++)
+	{
+		for(unsigned int c = 0; c < shardGrams[t]->size(); c++)
+		{
+			const WordId* shardContext = shardGrams[t]->getContext(c);
+			for(int j = 0; j < order; j++)
+				context[j] = shardWords[shardContext[j]]->getId();
+
+			const vector<NGramEdge>& edges = shardGrams[t]->getEdges(c);
+			for(unsigned int j = 0; j < edges.size(); j++)
+				chainGrams[t]->add(&context[0], shardWords[edges[j].word]->getId(), edges[j].count);
+		}
+	}
+
+	// The shard kept its sentences for the log if the chain is recording them
+	for(unsigned int i = 0; i < shard.sentences.size(); i++)
+	{
+		int index = shard.sentences[i];
+		pendingSentences.push_back(index == SHARD_END ? NO_WORD : shardWords[index]->getId());
+	}
+}
+
+
+// Splits the given text into sentences ending with a period. Text after the last period
+// is not part of any sentence, unless the text has no period at all, in which case all
+// of it is one sentence. The sentences refer to the given text, which must outlive them.
+void MarkovChain::splitSentences(string_view text, vector<string_view>& sentences)
+{
+	// Find the index of end of the first sentence
+	size_t period = text.find('.');
+
+	// The index of end of the previous sentence (start of the current)
+	size_t lastPeriod = 0;
+
+	if(period == string_view::npos)
+	{
+		if(text.length() == 0)
+			return;
+
+		period = text.length() - 1;
+	}
+
+	// For each sentence in the text
+	while(period != string_view::npos)
+	{
+		if(text[lastPeriod] == '.')
+			lastPeriod++;
+
+		// Pull out the text between the two period index
+		sentences.push_back(text.substr(lastPeriod, period - lastPeriod + 1));
+
+		// Find the next sentence boundaries for the next iteration
+		lastPeriod = period;
+		period = text.find('.', period + 1);
+	}
+}
+
+
+// Utility function to strip off and non-letter characters from the words of a
+// sentence. Non-letter characters are anything other than A-Z or a-z. Only characters
+// on either end of the word are stripped. Those inside, surrounded by letters
+// are preserved. Words left with no characters at all are removed.
+void MarkovChain::cleanTokens(vector<string_view>& tokens)
+{
+	unsigned int kept = 0;
+
+	//  For each word in the given sentence
+	for(unsigned int i = 0; i < tokens.size(); i++)
+	{
+		string_view token = tokens[i];
+
+		// Trim non-letters from the left side. Stop at the first letter, so that
+		// interior non-letters are preserved
+		while(token.length() > 0 && !isLetter(token.front()))
+			token.remove_prefix(1);
+
+		// Then the same from the right side
+		while(token.length() > 0 && !isLetter(token.back()))
+			token.remove_suffix(1);
+
+		if(token.length() > 0)
+			tokens[kept++] = token;
+	}
+
+	tokens.resize(kept);
+}
+
+
+// Breaks up the given sentence into whitespace-delimited words and replaces the contents
+// of words with them. The words refer to the given text, which must outlive them.
+void MarkovChain::tokenize(string_view text, vector<string_view>& words)
+{
+	words.clear();
+
+	// Index of the current character being examined
+	size_t i = 0;
+	size_t length = text.length();
+
+	for(;;)
+	{
+		// Skip to the start of the next word
+		while(i < length && isWhitespace(text[i]))
+			i++;
+
+		if(i >= length)
+			break;
+
+		size_t first = i;
+		while(i < length && !isWhitespace(text[i]))
+			i++;
+
+		words.push_back(text.substr(first, i - first));
+	}
+
+	// Remove non-letter characters
+	cleanTokens(words);
+}
+
+
+// Utility function. Checks the given character for one of the "C" whitespace characters
+bool MarkovChain::isWhitespace(char c)
+{
+	return c == '\n' || c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+
+// Utility function. Check whether the given character is a letter. Letters consist
+// of A-Z and a-z
+bool MarkovChain::isLetter(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+
+// Utility function. Replaces the contents of folded with the given word, its letters A-Z
+// made lower case
+void MarkovChain::foldCase(string_view word, string& folded)
+{
+	folded.assign(word.data(), word.length());
+
+	for(unsigned int i = 0; i < folded.length(); i++)
+	{
+		if(folded[i] >= 'A' && folded[i] <= 'Z')
+			folded[i] += 'a' - 'A';
+	}
+}
+
+
+// Adds the word with the given id to the words of its lower case form. Words must be added
+// in order of their ids.
+void MarkovChain::addFolded(WordId id)
+{
+	string folded;
+	foldCase(dictionary.getText(id), folded);
+
+	WordId form = foldedDictionary.intern(folded);
+	foldedNext.push_back(NO_WORD);
+
+	if(form == (WordId)foldedFirst.size())
+		foldedFirst.push_back(id);
+	else
+	{
+		foldedNext[id] = foldedFirst[form];
+		foldedFirst[form] = id;
+	}
+}
+
+
+// Finds the word to generate around for the given seed text. The seed is split into words
+// in the calling thread's scratch lists, every word is looked up in one batch, and one of
+// those found is chosen at random. With case folding on, a word not found as written is
+// matched to the most common word with the same lower case form. Returns start if no word
+// of the seed is in the chain.
+Word* MarkovChain::findSeed(string_view seed, Random& random) const
+{
+	GenerationBuffer& buffer = GenerationBuffer::local();
+	vector<string_view>& seedWords = buffer.seedWords;
+	vector<unsigned int>& seedIds = buffer.seedIds;
+
+	tokenize(seed, seedWords);
+	if(seedWords.empty())
+		return start;
+
+	seedIds.resize(seedWords.size());
+	dictionary.findAll(&seedWords[0], seedWords.size(), (WordId*)&seedIds[0]);
+
+	unsigned int found = 0;
+	for(unsigned int i = 0; i < seedWords.size(); i++)
+	{
+		WordId id = (WordId)seedIds[i];
+
+		if(id == NO_WORD && caseFolding)
+		{
+			foldCase(seedWords[i], buffer.foldedWord);
+
+			WordId form = foldedDictionary.find(buffer.foldedWord);
+			if(form != NO_WORD)
+			{
+				id = foldedFirst[form];
+				for(WordId other = foldedNext[id]; other != NO_WORD; other = foldedNext[other])
+				{
+					if(words[other]->getOccurrences() > words[id]->getOccurrences())
+						id = other;
+				}
+			}
+		}
+
+		if(id != NO_WORD)
+			seedIds[found++] = id;
+	}
+
+	if(found == 0)
+		return start;
+
+	return words[seedIds[random.nextInt(found)]];
+}
+
+
+// Multiplies the probability of each sentence of the given text into the score, as
+// scoreSentence describes. The text is split into sentences and words as addText splits it,
+// and every word is looked up in one batch. For an order above 1, a word is predicted from
+// the run of words before it when that run was seen, and from the single word before it
+// otherwise, as getRandomNext chooses it.
+void MarkovChain::scoreText(string_view text, double smoothing, SentenceScore& score) const
+{
+	GenerationBuffer& buffer = GenerationBuffer::local();
+	vector<string_view>& textWords = buffer.seedWords;
+	vector<unsigned int>& sentenceEnds = buffer.sentenceEnds;
+	vector<unsigned int>& ids = buffer.seedIds;
+	vector<unsigned int>& padded = buffer.context;
+
+	Tokenizer::tokenize(text, textWords, sentenceEnds);
+	if(textWords.empty())
+		return;
+
+	ids.resize(textWords.size());
+	dictionary.findAll(&textWords[0], textWords.size(), (WordId*)&ids[0]);
+
+	unsigned int vocabulary = words.size() - 1;
+	unsigned int begin = 0;
+
+	for(unsigned int s = 0; s < sentenceEnds.size(); s++)
+	{
+		// Each sentence is preceded by order starts and followed by an end, as it was added
+		padded.assign(order, start->getId());
+		for(unsigned int i = begin; i < sentenceEnds[s]; i++)
+		{
+			if((WordId)ids[i] == NO_WORD)
+				score.unknownCount++;
+
+			padded.push_back(ids[i]);
+		}
+
+		begin = sentenceEnds[s];
+		if(padded.size() == (size_t)order)
+			continue;
+
+		padded.push_back(end->getId());
+
+		for(unsigned int i = order; i < padded.size(); i++)
+		{
+			WordId next = (WordId)padded[i];
+			WordId previous = (WordId)padded[i - 1];
+			int count = 0;
+			int total = 0;
+			int number = (order > 1) ? postfixGrams.find((const WordId*)&padded[i - order]) : NO_CONTEXT;
+
+			if(number != NO_CONTEXT)
+			{
+				count = postfixGrams.getCount(number, next);
+				total = postfixGrams.getTotal(number);
+			}
+			else if(previous != NO_WORD)
+			{
+				const WordLinks& links = words[previous]->getLinks();
+				WordLinks::const_iterator link = links.find(next);
+
+				if(link != links.end())
+					count = link->second.postfixOccurrences;
+
+				total = words[previous]->getTotal(GENERATE_POSTFIX);
+			}
+
+			score.addPrediction(count, total, smoothing, vocabulary);
+		}
+	}
+}
+
+
+// Chooses the next word of the string being generated in the given direction. For an order
+// above 1, the last order words generated in that direction choose it, falling back on the
+// single word links of the word before it when fewer than order words are known or they
+// were never seen together. The far end of the string is terminated when generation has
+// already reached start or end there, so its terminator can pad a short string.
+Word* MarkovChain::getRandomNext(int direction, Word* word, bool terminated, GenerationBuffer& buffer, Random& random) const
+{
+	if(order > 1)
+	{
+		Word* terminator = (direction == GENERATE_POSTFIX) ? start : end;
+		const NGramTable& grams = (direction == GENERATE_POSTFIX) ? postfixGrams : prefixGrams;
+
+		buffer.context.resize(order);
+		if(buffer.getContext(direction, terminated, terminator->getId(), order, &buffer.context[0]))
+		{
+			int number = grams.find((const WordId*)&buffer.context[0]);
+			if(number != NO_CONTEXT)
+			{
+				STATS_RECORD(stats, STAT_FANOUT, grams.getEdges(number).size());
+
+				if(policy.isProportional())
+					return words[grams.sample(number, random)];
+
+				// The ranked words of a context are most common first, so only those the policy
+				// can choose are counted
+				const vector<NGramEdge>& edges = grams.getRanks(number);
+				int candidates = (policy.topK > 0) ? min(policy.topK, (int)edges.size()) : edges.size();
+				buffer.rankCounts.resize(candidates);
+				buffer.rankTotals.resize(candidates);
+
+				int total = 0;
+				for(int i = 0; i < candidates; i++)
+				{
+					total += edges[i].count;
+					buffer.rankCounts[i] = edges[i].count;
+					buffer.rankTotals[i] = total;
+				}
+
+				return words[edges[policy.choose(&buffer.rankCounts[0], &buffer.rankTotals[0], candidates, random)].word];
+			}
+		}
+	}
+
+	STATS_RECORD(stats, STAT_FANOUT, word->getFanout(direction));
+	return word->getRandom(direction, policy, random);
+}
+
+
+// Fills the buffer's context with the order words next to the given partial string of a beam
+// search, on the side it grows toward, as GenerationBuffer::getContext does for the string
+// being generated. The partial string's words come first, then the words already in the
+// buffer. Returns false if fewer than order words are known and the far end of the string
+// hasn't been terminated.
+bool MarkovChain::getBeamContext(int direction, int node, bool terminated, GenerationBuffer& buffer) const
+{
+	buffer.context.resize(order);
+	int known = 0;
+
+	// Gather the words nearest the growing end first. A postfix context ends with the nearest
+	// word and a prefix context begins with it.
+	for(; node >= 0 && known < order; node = buffer.beamNodes[node].parent)
+	{
+		int position = (direction == GENERATE_POSTFIX) ? order - 1 - known : known;
+		buffer.context[position] = buffer.beamNodes[node].word;
+		known++;
+	}
+
+	for(unsigned int i = 0; i < buffer.wordCount && known < order; i++)
+	{
+		int position = (direction == GENERATE_POSTFIX) ? order - 1 - known : known;
+		buffer.context[position] = buffer.getWord((direction == GENERATE_POSTFIX) ? buffer.wordCount - 1 - i : i);
+		known++;
+	}
+
+	if(known < order && !terminated)
+		return false;
+
+	unsigned int terminator = (direction == GENERATE_POSTFIX) ? start->getId() : end->getId();
+	for(; known < order; known++)
+	{
+		int position = (direction == GENERATE_POSTFIX) ? order - 1 - known : known;
+		buffer.context[position] = terminator;
+	}
+
+	return true;
+}
+
+
+// Finds the likeliest words from the seed to the terminator of the given direction within the
+// given number of steps, and adds them to the buffer's string on that side. Each step grows
+// every partial string kept by the policy's beam width of its likeliest next words, taken from
+// the front of its context's words or of its word's rank table, and keeps the beam width of
+// the likeliest of all of them. Reaching the terminator counts as a step, as in appendString.
+// A partial string only gets less likely as it grows, so the search ends once no partial
+// string kept is likelier than the likeliest one that reached the terminator. Sets reached
+// when the words found end at the terminator, or where the chain has no next word, and
+// returns the number of steps taken.
+int MarkovChain::searchBeam(int direction, Word* seed, bool terminated, int maxSteps, GenerationBuffer& buffer, bool& reached) const
+{
+	const NGramTable& grams = (direction == GENERATE_POSTFIX) ? postfixGrams : prefixGrams;
+	unsigned int terminator = (direction == GENERATE_POSTFIX) ? end->getId() : start->getId();
+	int width = policy.beamWidth;
+
+	vector<BeamNode>& nodes = buffer.beamNodes;
+	nodes.clear();
+	buffer.beam.assign(1, -1);
+
+	// The likeliest string that reached the terminator, and the likeliest with no next word
+	int finished = -1;
+	int deadEnd = -1;
+	bool deadEndFound = false;
+
+	// The score of a partial string by index, -1 being the seed alone
+	auto scoreOf = [&nodes](int node)
+	{
+		return (node < 0) ? 0.0 : nodes[node].score;
+	};
+
+	for(int step = 0; step < maxSteps && !buffer.beam.empty(); step++)
+	{
+		buffer.beamGrown.clear();
+
+		for(unsigned int b = 0; b < buffer.beam.size(); b++)
+		{
+			int node = buffer.beam[b];
+			double score = scoreOf(node);
+			Word* word = (node < 0) ? seed : words[nodes[node].word];
+
+			// The next words and their counts, from the context of the partial string where
+			// there is one, as in getRandomNext, or else from its last word
+			const vector<NGramEdge>* edges = NULL;
+			const RankTable* ranks = NULL;
+			int candidates = 0;
+			double total = 0;
+
+			if(order > 1 && getBeamContext(direction, node, terminated, buffer))
+			{
+				int number = grams.find((const WordId*)&buffer.context[0]);
+				if(number != NO_CONTEXT)
+				{
+					edges = &grams.getRanks(number);
+					candidates = min(width, (int)edges->size());
+					total = grams.getTotal(number);
+				}
+			}
+
+			if(edges == NULL && word->getTotal(direction) > 0)
+			{
+				ranks = word->getRanks(direction);
+				candidates = min(width, ranks->size());
+				total = word->getTotal(direction);
+			}
+
+			if(candidates == 0)
+			{
+				if(!deadEndFound || score > scoreOf(deadEnd))
+				{
+					deadEnd = node;
+					deadEndFound = true;
+				}
+				continue;
+			}
+
+			for(int c = 0; c < candidates; c++)
+			{
+				BeamNode grown;
+				grown.parent = node;
+				grown.word = (edges != NULL) ? (*edges)[c].word : ranks->getWord(c)->getId();
+				grown.score = score + log(((edges != NULL) ? (*edges)[c].count : ranks->getCount(c)) / total);
+
+				if(grown.word == terminator)
+				{
+					if(finished != -1 && grown.score <= nodes[finished].score)
+						continue;
+
+					finished = nodes.size();
+				}
+				else
+					buffer.beamGrown.push_back(nodes.size());
+
+				nodes.push_back(grown);
+			}
+		}
+
+		// Keep the likeliest of the grown partial strings, the earliest grown among equals
+		sort(buffer.beamGrown.begin(), buffer.beamGrown.end(), [&nodes](int a, int b)
+		{
+			return (nodes[a].score != nodes[b].score) ? nodes[a].score > nodes[b].score : a < b;
+		});
+
+		if((int)buffer.beamGrown.size() > width)
+			buffer.beamGrown.resize(width);
+
+		buffer.beam.swap(buffer.beamGrown);
+
+		if(finished != -1 && (buffer.beam.empty() || nodes[buffer.beam[0]].score <= nodes[finished].score))
+			break;
+	}
+
+	// Take the likeliest string that reached the terminator, then the likeliest one cut short
+	// by the steps or by having no next word
+	int result;
+	reached = true;
+
+	if(finished != -1)
+		result = nodes[finished].parent;
+	else if(!buffer.beam.empty() && (!deadEndFound || scoreOf(buffer.beam[0]) > scoreOf(deadEnd)))
+	{
+		result = buffer.beam[0];
+		reached = false;
+	}
+	else
+		result = deadEnd;
+
+	// Add the words of the result to the string in the order they were found, nearest the
+	// seed first. The beam is no longer needed, so it holds them while they're gathered.
+	buffer.beam.clear();
+	for(int node = result; node >= 0; node = nodes[node].parent)
+		buffer.beam.push_back(nodes[node].word);
+
+	for(int i = buffer.beam.size() - 1; i >= 0; i--)
+	{
+		if(direction == GENERATE_POSTFIX)
+			buffer.pushBack(buffer.beam[i]);
+		else
+			buffer.pushFront(buffer.beam[i]);
+	}
+
+	// The terminator, or the missing next word, took a step of its own
+	return buffer.beam.size() + (reached ? 1 : 0);
+}
+
+
+// Generates one semi-random string in the same manner as generateString and writes it to
+// the end of the buffer. Words are held by id in the buffer's ring, which grows at whichever
+// end a word is added to, until both ends are found. Nothing is allocated per word, and
+// nothing at all once the buffer has grown large enough.
+void MarkovChain::appendString(int direction, Word* seed, int maxWordCount, GenerationBuffer& buffer, Random& random) const
+{
+	STATS_TIMER(generating);
+	buffer.startString(maxWordCount);
+
+	// A real seed word is in the middle of the string
+	if(seed != start && seed != end)
+		buffer.pushBack(seed->getId());
+
+	Word* ws = seed;
+	Word* we = seed;
+
+	bool startReached = (direction & GENERATE_PREFIX) == 0 || ws == start;
+	bool endReached = (direction & GENERATE_POSTFIX) == 0 || we == end;
+
+	int i = 0;
+
+	// A beam search finds the words before the seed first, in about half of the steps when
+	// there are words after it to find too, and then the words after it, given them
+	if(policy.beamWidth > 0)
+	{
+		bool prefixFound = false;
+
+		if(!startReached)
+		{
+			int steps = endReached ? maxWordCount : (maxWordCount + 1) / 2;
+			i += searchBeam(GENERATE_PREFIX, seed, seed == end, steps, buffer, startReached);
+			prefixFound = startReached;
+		}
+
+		if(!endReached)
+			i += searchBeam(GENERATE_POSTFIX, seed, seed == start || prefixFound, maxWordCount - i, buffer, endReached);
+	}
+
+	// Otherwise generate in both directions in turn, one word each
+	while(policy.beamWidth == 0 && i < maxWordCount)
+	{
+		if(startReached && endReached)
+			break;
+
+		if(!startReached)
+		{
+			ws = getRandomNext(GENERATE_PREFIX, ws, we == end, buffer, random);
+			i++;
+
+			if(ws == start || ws == NULL)
+				startReached = true;
+			else
+				buffer.pushFront(ws->getId());
+		}
+
+		if(!endReached)
+		{
+			we = getRandomNext(GENERATE_POSTFIX, we, ws == start, buffer, random);
+			i++;
+
+			if(we == end || we == NULL)
+				endReached = true;
+			else
+				buffer.pushBack(we->getId());
+		}
+	}
+
+	// Measure the string first, so the text grows once and each word, followed by a space,
+	// is copied straight into place
+	size_t length = 0;
+	for(unsigned int i = 0; i < buffer.wordCount; i++)
+		length += words[buffer.getWord(i)]->getText().length() + 1;
+
+	char* output = buffer.extendText(length);
+	for(unsigned int i = 0; i < buffer.wordCount; i++)
+	{
+		string_view wordText = words[buffer.getWord(i)]->getText();
+		memcpy(output, wordText.data(), wordText.length());
+		output += wordText.length();
+		*output++ = ' ';
+	}
+
+	buffer.finishString();
+
+	STATS_ADD(stats, STAT_STRINGS, 1);
+	STATS_ADD(stats, STAT_STEPS, i);
+	STATS_ADD(stats, (startReached && endReached) ? STAT_END_REACHED : STAT_LENGTH_REACHED, 1);
+	STATS_RECORD(stats, STAT_LENGTH, buffer.wordCount);
+	STATS_RECORD_ELAPSED(stats, STAT_LATENCY, generating);
+}
+
+
+// Returns the engine to generate from when the caller gives none. With a seed set, that's the
+// given engine, seeded with it and the number of the call, so that the n-th such call since
+// the seed was set always draws the same numbers, and no two calls draw the same ones.
+// Otherwise it's the calling thread's own engine.
+Random& MarkovChain::getEngine(Random& seededEngine) const
+{
+	if(!seeded)
+		return Random::local();
+
+	unsigned long long call = seededCalls.fetch_add(1, memory_order_relaxed);
+	seededEngine.seed(generationSeed + call * SEED_CALL_STRIDE);
+	return seededEngine;
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes up an empty MarkovChain
+MarkovChain::MarkovChain()
+{
+	order = 1;
+	samplingMode = SAMPLE_CUMULATIVE;
+	checkpointSize = 0;
+	logSize = 0;
+	memoryBudget = 0;
+	caseFolding = false;
+	seeded = false;
+	generationSeed = 0;
+	seededCalls = 0;
+
+	// Initialize the start and end to empty strings so that they will not interfere
+	// with any valid word that could be added to the dictionary
+	initTerminators();
+}
+
+
+// Initializes a MarkovChain using the given serialized chain file
+MarkovChain::MarkovChain(string fileName)
+{
+	order = 1;
+	samplingMode = SAMPLE_CUMULATIVE;
+	checkpointSize = 0;
+	logSize = 0;
+	memoryBudget = 0;
+	caseFolding = false;
+	seeded = false;
+	generationSeed = 0;
+	seededCalls = 0;
+	initTerminators();
+	load(fileName);
+}
+
+
+// Frees every Word at once
+MarkovChain::~MarkovChain()
+{
+	release();
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Replaces the contents of the chain with the chain saved in the given file, followed by the
+// sentences in its log if it was written by checkpoint. Returns false, changing nothing, if
+// the file can't be read or wasn't written by save or checkpoint.
+bool MarkovChain::load(string fileName)
+{
+	return load(fileName, 1);
+}
+
+
+// Loads the chain saved in the given file as load(string) does, verifying the file and
+// rebuilding the words and their links on the given number of threads. The sentences in the
+// file's log are added on the calling thread.
+bool MarkovChain::load(string fileName, int threadCount)
+{
+	FrozenChain image;
+	if(!image.load(fileName, true, threadCount))
+		return false;
+
+	clear();
+	setOrder(image.header->order);
+	addImage(image, threadCount);
+
+	// Add the sentences logged since the image was written. A log that belongs to another
+	// image is ignored, and so is anything after a record left incomplete by a crash.
+	CheckpointLog log;
+	if(!log.open(fileName + LOG_SUFFIX, image.header->checksum))
+		return true;
+
+	vector<string_view> recordWords;
+	vector<unsigned int> numbers;
+	vector<string_view> sentence;
+
+	while(log.readRecord(recordWords, numbers))
+	{
+		for(unsigned int i = 0; i < numbers.size(); i++)
+		{
+			if(numbers[i] != LOG_SENTENCE_END)
+				sentence.push_back(recordWords[numbers[i]]);
+			else if(sentence.size() > 0)
+			{
+				addSentence(&sentence[0], sentence.size());
+				sentence.clear();
+			}
+		}
+	}
+
+	// Later checkpoints append to the log, unless part of it couldn't be read, in which
+	// case the next one rewrites the file so nothing is appended after the damage
+	if(log.isFinished())
+	{
+		checkpointName = fileName;
+		checkpointSize = image.imageSize;
+		logSize = log.getSize();
+	}
 
-	dictionary[startText] = start;
-	dictionary[endText] = end;
+	return true;
 }
 
 
-// Reinitializes the stand and end words with auto-incrementing ids
-void MarkovChain::initTerminators()
+// Saves the MarkovChain into the given file as a frozen image, which either load or
+// FrozenChain::load can read back
+void MarkovChain::save(string fileName)
+{
+	save(fileName, 1);
+}
+
+
+// Saves the MarkovChain into the given file as save(string) does, encoding the links on the
+// given number of threads. The file is the same for any number of threads.
+void MarkovChain::save(string fileName, int threadCount)
 {
-	start = new Word(startText, this);
-	end = new Word(endText, this);
+	FrozenChain image(*this, FROZEN_EDGES_PLAIN, threadCount);
+	image.save(fileName);
 
-	dictionary[startText] = start;
-	dictionary[endText] = end;
+	// The file's log no longer follows it
+	if(fileName == checkpointName)
+		stopRecording();
 }
 
 
-// Writes the word and chain data to a file that can be used to reconstruct this same chain.
-void MarkovChain::serialize(ofstream& outFile)
+// Saves the sentences added since the last checkpoint to the log of the given chain file,
+// so the cost depends on how much text was added rather than on the size of the chain. The
+// first checkpoint to a file, or one after the chain changed in a way the log can't record,
+// rewrites the whole file with compact instead, and so does one that grows the log past
+// CHECKPOINT_COMPACT_RATIO times the size of the file. Returns false if a file could not be
+// written, in which case the next checkpoint rewrites the whole file.
+bool MarkovChain::checkpoint(string fileName)
 {
-	const int bufSize = 256;
-	char buf[bufSize];
+	if(fileName != checkpointName)
+		return compact(fileName);
+
+	if(pendingSentences.size() == 0)
+		return true;
 
-	auto i = dictionary.begin();
+	// Number the words of the record in the order they first appear in it
+	vector<string_view> recordWords;
+	vector<unsigned int> numbers;
+	numbers.reserve(pendingSentences.size());
 
-	// Write the header. For each word in the dictionary write the text and its id
-	for(; i != dictionary.end(); i++)
+	if(logNumbers.size() < words.size())
+		logNumbers.resize(words.size(), LOG_SENTENCE_END);
+
+	for(size_t i = 0; i < pendingSentences.size(); i++)
 	{
-		string text = (*i).first;
-		WordLink link = (*i).second;
+		WordId id = pendingSentences[i];
+		if(id == NO_WORD)
+		{
+			numbers.push_back(LOG_SENTENCE_END);
+			continue;
+		}
+
+		if(logNumbers[id] == LOG_SENTENCE_END)
+		{
+			logNumbers[id] = recordWords.size();
+			recordWords.push_back(dictionary.getText(id));
+		}
 
-		// Write the word text
-		outFile.write(text.c_str(), text.length());
-		outFile.write("\n", 1);
+		numbers.push_back(logNumbers[id]);
+	}
 
-		// Write the id
-		itoa(link.word->getId(), buf, 10);
-		outFile.write(buf, strlen(buf));
-		outFile.write("\n", 1);
+	for(size_t i = 0; i < pendingSentences.size(); i++)
+	{
+		if(pendingSentences[i] != NO_WORD)
+			logNumbers[pendingSentences[i]] = LOG_SENTENCE_END;
 	}
 
-	outFile.write("\n", 1);
+	CheckpointLog log;
+	size_t written = log.append(checkpointName + LOG_SUFFIX, recordWords, numbers);
 
-	// Write the links associated with each word. The word text is given on one line, followed
-	// by each link, which consists of the word text, prefix occurrences and postfix occurrences
-	i = dictionary.begin();
-	for(; i != dictionary.end(); i++)
+	// A failed append may have left part of a record behind, which would hide every
+	// record appended after it
+	if(written == 0)
 	{
-		// Let the word serialize its own links
-		(*i).second->serialize(outFile);
+		stopRecording();
+		return false;
 	}
+
+	pendingSentences.clear();
+	logSize += written;
+
+	if(logSize > checkpointSize * CHECKPOINT_COMPACT_RATIO)
+		return compact(fileName);
+
+	return true;
 }
 
 
-void MarkovChain::unserialize(ifstream& inFile)
+// Rewrites the given chain file with the whole chain and starts an empty log for it, which
+// later checkpoints append to. The image is written to a temporary file and renamed over the
+// old one, so a crash leaves either the old file or the new one. A crash before the log is
+// replaced leaves the old log, which names the old image's checksum and so is never applied
+// to the new one. Returns false if a file could not be written.
+bool MarkovChain::compact(string fileName)
 {
-	const int bufSize = 256;
-	char buf[bufSize];
+	FrozenChain image(*this);
+	string temporaryName = fileName + ".tmp";
+
+	if(!image.save(temporaryName))
+		return false;
 
-	// Load the basic word info header. Contains the text of the word and its id
-	while(!inFile.eof() && !inFile.bad() && inFile.is_open())
+#ifdef _WIN32
+	remove(fileName.c_str());
+#endif
+
+	if(rename(temporaryName.c_str(), fileName.c_str()) != 0)
 	{
-		inFile.getline(buf, bufSize);
-		if(!strlen(buf))
-			break;
+		remove(temporaryName.c_str());
+		return false;
+	}
 
-		string text = buf;
+	stopRecording();
 
-		inFile.getline(buf, bufSize);
-		int id = atoi(buf);
+	if(!CheckpointLog::create(fileName + LOG_SUFFIX, image.header->checksum))
+		return false;
 
-		Word* word = new Word(text, id, this);
-		dictionary[text] = word;
-	}
+	checkpointName = fileName;
+	checkpointSize = image.imageSize;
+	logSize = sizeof(LogHeader);
 
-	// Pull the new terminators from the dictionary
-	start = dictionary[startText];
-	end = dictionary[endText];
+	return true;
+}
 
-	// Parse each word's links now that all words have been initialized
-	while(!inFile.eof() && !inFile.bad())
-	{
-		// First line is the word text. This must be done outside the Word's serialize function
-		// go that the appropriate word can be found on which to call serialize
-		inFile.getline(buf, bufSize);
-		string text = buf;
-		if(!text.length())
-			continue;
 
-		Word* word = dictionary[text];
-		word->unserialize(inFile);
-	}
-	
-	return;
+// Removes all words from the dictionary and reinitializes start and end. The Words and
+// their links are freed together with the arena that holds them.
+void MarkovChain::clear()
+{
+	release();
+	dictionary.clear();
+	postfixGrams.clear();
+	prefixGrams.clear();
+	foldedDictionary.clear();
+	vector<WordId>().swap(foldedFirst);
+	vector<WordId>().swap(foldedNext);
+	stopRecording();
+	initTerminators();
 }
 
 
-// Utility function to strip off and non-letter characters from the words of a
-// sentence. Non-letter characters are anything other than A-Z or a-z. Only characters
-// on either end of the string are stripped. Those inside, surrounded by letters
-// are preserved. The words are trimmed in situ
-void MarkovChain::cleanTokens(vector<string>& tokens)
+// Add text to the chain's corpus. The text should have space delimited sentences
+void MarkovChain::addText(string_view text)
 {
-	//  For each word in the given sentence
-	for(unsigned int i = 0; i < tokens.size(); i++)
+	// Split the whole text into words and sentences in one pass, then link the words of
+	// each sentence together
+	vector<string_view> words;
+	vector<unsigned int> sentenceEnds;
+
+	STATS_TIMER(tokenizing);
+	Tokenizer::tokenize(text, words, sentenceEnds);
+	STATS_ELAPSED(stats, STAT_TOKENIZE_NANOSECONDS, tokenizing);
+
+	STATS_TIMER(inserting);
+	addSentences(words, sentenceEnds);
+	STATS_ELAPSED(stats, STAT_INSERT_NANOSECONDS, inserting);
+
+	enforceBudget();
+}
+
+
+// Adds all of the text read from the given stream to the chain's corpus. The text is read
+// in fixed-size chunks, and only the complete sentences of each chunk are added, the rest
+// being carried over to the next. Since no more than a chunk and one unfinished sentence are
+// in memory at once, streams of any size can be added. Text after the last period of the
+// stream is always added as a final sentence, unlike addText, which drops it unless the
+// text has no period at all, so the result doesn't depend on where the chunks end. A run
+// of more than MAX_SENTENCE_LENGTH bytes without a period is broken at its last whitespace,
+// so even text with no periods can't grow the buffer forever.
+void MarkovChain::addStream(istream& stream)
+{
+	vector<char> buffer(STREAM_CHUNK_SIZE);
+
+	// The number of bytes at the front of the buffer carried over from the last chunk
+	size_t carried = 0;
+
+	vector<string_view> words;
+	vector<unsigned int> sentenceEnds;
+
+	while(stream)
 	{
-		int tokensize = tokens[i].size();
-		int charCount = 0;
+		if(buffer.size() < carried + STREAM_CHUNK_SIZE)
+			buffer.resize(carried + STREAM_CHUNK_SIZE);
+
+		stream.read(&buffer[carried], STREAM_CHUNK_SIZE);
+		size_t size = carried + stream.gcount();
+		string_view text(&buffer[0], size);
 
-		// Count the non-letter characters on the left side of the string
-		for(int j = 0; j < tokensize; j++)
+		// Everything up to the last period is complete sentences. A sentence too long to carry
+		// any further is cut short.
+		size_t complete = text.rfind('.') + 1;
+
+		if(stream && complete == 0 && size >= MAX_SENTENCE_LENGTH)
 		{
-			// Break if a letter is encountered, so that interior non-letters
-			// are preserved
-			if(!isLetter(tokens[i][j]))
-				charCount++;
-			else
-				break;
+			complete = size;
+			for(size_t i = size; i > 0; i--)
+			{
+				if(isWhitespace(text[i - 1]))
+				{
+					complete = i;
+					break;
+				}
+			}
 		}
 
-		// Remove the characters found
-		tokens[i].erase(0, charCount);
+		// At the end of the stream, the text after the last period is a sentence of its own.
+		// It's tokenized apart from the complete sentences, since the tokenizer drops the text
+		// after the last period of whatever it's given, and keeps it only if there is none.
+		string_view pieces[2] = {text.substr(0, complete), text.substr(complete)};
+		int pieceCount = stream ? 1 : 2;
 
-		// Reset the size since the string may have changed from
-		tokensize = tokens[i].size();
-		charCount = 0;
-
-		// Count the non-letter characters on the right side of the string		
-		for(int j = tokensize - 1; j >= 0; j--)
+		for(int p = 0; p < pieceCount; p++)
 		{
-			// Break if a letter is encountered, so that interior non-letters
-			// are preserved
-			if(!isLetter(tokens[i][j]))
-				charCount++;
-			else
-				break;
+			STATS_TIMER(tokenizing);
+			Tokenizer::tokenize(pieces[p], words, sentenceEnds);
+			STATS_ELAPSED(stats, STAT_TOKENIZE_NANOSECONDS, tokenizing);
+
+			STATS_TIMER(inserting);
+			addSentences(words, sentenceEnds);
+			STATS_ELAPSED(stats, STAT_INSERT_NANOSECONDS, inserting);
 		}
 
-		// Remove the characters found
-		tokens[i].erase(tokensize - charCount, charCount);
+		enforceBudget();
+
+		if(!stream)
+			break;
+
+		// Move the unfinished sentence to the front for the next chunk to complete
+		carried = size - complete;
+		memmove(&buffer[0], &buffer[complete], carried);
 	}
 }
 
 
-// Breaks up the given sentence into whitespace-delimited words.
-// Returns a vector containing each word that was found.
-vector<string> MarkovChain::tokenize(string text, int order)
+// Adds the text of the given file to the chain's corpus by streaming it through addStream.
+// Returns false if the file could not be opened.
+bool MarkovChain::addFile(string fileName)
 {
-	vector<string> words;
+	ifstream file(fileName.c_str(), ios::in | ios::binary);
+	if(!file.is_open())
+		return false;
+
+	addStream(file);
+	return true;
+}
 
-	// Index where the previous whitespace was found
-	int lastSpace = 0;
 
-	// Index of the current character being examined
-	unsigned int i = 0;
+// Adds several texts to the chain's corpus using the given number of threads. The sentences
+// of all of the texts are divided into contiguous shares of about the same size, each thread
+// counts the words and links of one share on its own, and the counts are then merged into
+// the chain in order. The result is the same as calling addText on each text in turn: the
+// words get the same ids and every count is the same, so a seed draws the same strings from
+// it at any order and with any generation policy.
+void MarkovChain::addTexts(const vector<string>& texts, int threadCount)
+{
+	vector<string_view> sentences;
+	size_t totalSize = 0;
+
+	for(unsigned int i = 0; i < texts.size(); i++)
+	{
+		splitSentences(texts[i], sentences);
+		totalSize += texts[i].length();
+	}
+
+	if(threadCount < 1)
+		threadCount = 1;
+
+	// Balance the shares by bytes rather than sentences, since sentence lengths vary
+	vector<size_t> bounds(1, 0);
+	size_t shareSize = totalSize / threadCount + 1;
+	size_t size = 0;
+
+	for(unsigned int i = 0; i < sentences.size(); i++)
+	{
+		size += sentences[i].length();
+
+		if(size >= shareSize * bounds.size() && (int)bounds.size() < threadCount)
+			bounds.push_back(i + 1);
+	}
+	bounds.push_back(sentences.size());
 
-	// The number of real words that have been included in the current token
-	int orderCount = 0;
+	vector<ChainShard> shards(bounds.size() - 1);
+	vector<thread> threads;
 
-	// In the case of multiple sequential whitespace characters, this is set when
-	// encounting the first whitespace character, and unset on the first non-whitespace
-	// character, ensuring the orderCount is only incremented once.
-	bool orderFlag = false;
+	// Each sentence is tokenized and counted together, so all of the time counts as insertion
+	STATS_TIMER(inserting);
 
-	// For each character in the sentence
-	for(; i < text.length(); i++)
+	for(unsigned int s = 0; s < shards.size(); s++)
 	{
-		// Continue until a whitespace character is found, meaning a word has
-		// been traversed
-		if(isWhitespace(text[i]))
+		shards[s].setOrder(order);
+		shards[s].recording = !checkpointName.empty();
+	}
+
+	for(unsigned int s = 0; s < shards.size(); s++)
+	{
+		threads.push_back(thread([&, s]()
 		{
-			// Skip tokenizing on this whitespace if the number of words in the
-			// token has not reached the order yet
-			if(orderFlag == false && orderCount < order - 1)
+			vector<string_view> words;
+			vector<unsigned int> sentenceEnds;
+
+			// Each sentence holds at most one period, at its end, so it tokenizes to at most
+			// one sentence of words
+			for(size_t i = bounds[s]; i < bounds[s + 1]; i++)
 			{
-				orderFlag = true;
-				orderCount++;
-				continue;
+				Tokenizer::tokenize(sentences[i], words, sentenceEnds);
+				if(sentenceEnds.size() > 0)
+				{
+					shards[s].addSentence(&words[0], sentenceEnds[0]);
+					STATS_ADD(stats, STAT_SENTENCES, 1);
+					STATS_ADD(stats, STAT_TOKENS, sentenceEnds[0]);
+				}
 			}
+		}));
+	}
+
+	for(unsigned int s = 0; s < threads.size(); s++)
+		threads[s].join();
+
+	for(unsigned int s = 0; s < shards.size(); s++)
+	{
+		mergeShard(shards[s]);
+		enforceBudget();
+	}
 
-			string s;
+	STATS_ELAPSED(stats, STAT_INSERT_NANOSECONDS, inserting);
+}
 
-			// A word must be at least 1 character long, so there must be a minimum
-			// difference of 2 between lastSpace and i. However, on the first iteration,
-			// lastSpace points to index 0, which is likely a letter character.
-			// Use lastSpace inclusively in this case
-			if(i - lastSpace > 1 && lastSpace > 0)
-				s = text.substr(lastSpace + 1, i - 1 - lastSpace);
-			else if(i - lastSpace == 1 || lastSpace == 0)
-				s = text.substr(lastSpace, i - lastSpace);
 
-			// An additional, and probably unnecessary check for empty words
-			if(!isWhitespace(s))
-				words.push_back(s);
+// Adds the counts of another chain to this one, as if the text it was trained on had been
+// added here too. Words are matched by text, so chains trained apart, in other processes or on
+// other machines, can be combined without their text. Words this chain doesn't have are
+// created in the order of the other chain's ids. Each link is visited once, so merging takes
+// time in proportion to the other chain's links. Returns false, changing nothing, if the
+// chains have different orders, unless this one is empty, in which case it takes the other's.
+bool MarkovChain::merge(const MarkovChain& other)
+{
+	if(other.order != order)
+	{
+		if(dictionary.size() > 2)
+			return false;
 
-			// Begin traversing the next word
-			lastSpace = i;
-		}
-		else if(orderFlag == true)
+		setOrder(other.order);
+	}
+
+	// Merging a chain into itself doubles its counts, so read every count before adding
+	vector<Word*> otherWords(other.words.size());
+	for(unsigned int i = 0; i < other.words.size(); i++)
+		otherWords[i] = addWord(other.words[i]->getText());
+
+	for(unsigned int i = 0; i < other.words.size(); i++)
+	{
+		otherWords[i]->addOccurrences(other.words[i]->getOccurrences());
+
+		// Each link is kept by both of its words, so each word adds only its own side of it
+		const WordLinks& links = other.words[i]->getLinks();
+		for(auto j = links.begin(); j != links.end(); j++)
 		{
-			// Reset the flag when encountering a non-whitespace character, meaning
-			// future whitespace will be the boundary of a new real word
-			orderFlag = false;
+			int postfixCount = j->second.postfixOccurrences;
+			int prefixCount = j->second.prefixOccurrences;
+
+			if(postfixCount > 0)
+				otherWords[i]->addPostfix(otherWords[j->first], postfixCount);
+
+			if(prefixCount > 0)
+				otherWords[i]->addPrefix(otherWords[j->first], prefixCount);
 		}
 	}
 
-	// Since most sentences don't end with a space, add the final word separately
-	if(i - lastSpace >= 1)
+	const NGramTable* otherGrams[2] = {&other.postfixGrams, &other.prefixGrams};
+	NGramTable* chainGrams[2] = {&postfixGrams, &prefixGrams};
+	vector<WordId> context(order);
+
+	for(int t = 0; t < 2 && order > 1; t++)
 	{
-		string lastword = text.substr(lastSpace + (lastSpace > 0 ? 1 : 0), i - (lastSpace > 0 ? 1 : 0) - lastSpace);
-		words.push_back(lastword);
-	}
+		// A table merged into itself gains no contexts, so its size is read only once
+		unsigned int contextCount = otherGrams[t]->size();
+		for(unsigned int c = 0; c < contextCount; c++)
+		{
+			const WordId* otherContext = otherGrams[t]->getContext(c);
+			for(int j = 0; j < order; j++)
+				context[j] = otherWords[otherContext[j]]->getId();
 
-	// Remove non-letter characters
-	cleanTokens(words);
+			const vector<NGramEdge>& edges = otherGrams[t]->getEdges(c);
+			unsigned int edgeCount = edges.size();
 
-	return words;
-}
+			for(unsigned int j = 0; j < edgeCount; j++)
+				chainGrams[t]->add(&context[0], otherWords[edges[j].word]->getId(), edges[j].count);
+		}
+	}
 
+	// The log holds sentences, which the other chain no longer has
+	stopRecording();
+	enforceBudget();
 
-// Utility function. Checks the given character for one of the "C" whitespace characters
-bool MarkovChain::isWhitespace(char c)
-{
-	return c == '\n' || c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	return true;
 }
 
 
-// Utility function. Check whether the given string is composed of only whitespace.
-bool MarkovChain::isWhitespace(string s)
+// Adds the counts of a frozen chain to this one, as merge does for a live chain. The image
+// can be a file mapped with FrozenChain::load, so saved chains can be combined without
+// loading each into a chain first.
+bool MarkovChain::merge(const FrozenChain& image)
 {
-	for(unsigned int i = 0; i < s.length(); i++)
+	if(image.header == NULL)
+		return false;
+
+	if((int)image.header->order != order)
 	{
-		if(!isWhitespace(s[i]))
+		if(dictionary.size() > 2)
 			return false;
+
+		setOrder(image.header->order);
 	}
 
+	addImage(image);
+
+	stopRecording();
+	enforceBudget();
+
 	return true;
 }
 
 
-// Utility function. Check whether the given character is a letter. Letters consist
-// of A-Z and a-z
-bool MarkovChain::isLetter(char c)
+// Sets the number of preceding words that determine how likely each word is to come next.
+// Order 1 is a plain chain of single words. The order should be set before any text is
+// added, since changing it discards the counts of runs of words gathered so far.
+void MarkovChain::setOrder(int order)
 {
-	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+	if(order < 1)
+		order = 1;
+
+	this->order = order;
+	postfixGrams.setOrder(order);
+	prefixGrams.setOrder(order);
+
+	// The counts of runs of words are gone, so the log can no longer rebuild them
+	stopRecording();
 }
 
-/*--------------------------------------------------------------------------------*/
-/*---------------------- Public Constructors & Destructors -----------------------*/
-/*--------------------------------------------------------------------------------*/
+
+// Returns the order of the chain
+int MarkovChain::getOrder() const
+{
+	return order;
+}
 
 
-// Initializes up an empty MarkovChain
-MarkovChain::MarkovChain()
+// Sets how Words choose random prefixes and postfixes. Either SAMPLE_CUMULATIVE or SAMPLE_ALIAS.
+// Cumulative tables take time in the log of a word's links and survive adding text, alias tables
+// take constant time but are rebuilt after a word's counts change.
+void MarkovChain::setSamplingMode(int mode)
 {
-	// Initialize the start and end to empty strings so that they will not interfere
-	// with any valid word that could be added to the dictionary
-	initTerminators();
+	samplingMode = mode;
 }
 
 
-// Initializes a MarkovChain using the given serialized chain file
-MarkovChain::MarkovChain(string fileName)
+// Returns the current sampling mode
+int MarkovChain::getSamplingMode() const
 {
-	initTerminators();
-	load(fileName);
+	return samplingMode;
 }
 
 
-// Deletes dynamically allocated memory and saves all training sentences to a file
-// allowing it to be read back in during the next startup to recreate the chain.
-MarkovChain::~MarkovChain()
+// Sets how generation chooses each next word, or whether it finds each string by a beam
+// search. Like the sampling mode, the policy must not change while other threads generate.
+void MarkovChain::setGenerationPolicy(const GenerationPolicy& policy)
 {
-	clear();
+	this->policy = policy;
 }
 
 
-/*--------------------------------------------------------------------*/
-/*---------------------- Public Methods ------------------------------*/
-/*--------------------------------------------------------------------*/
+// Returns the current generation policy
+const GenerationPolicy& MarkovChain::getGenerationPolicy() const
+{
+	return policy;
+}
 
 
-// Load the MarkovChain stored in the given file into this by calling the unserialize method
-void MarkovChain::load(string fileName)
+// Makes generation reproducible. Every call that isn't given an engine draws from a new engine
+// seeded with the given seed and the number of calls made since, so each call gives a different
+// string, and setting the same seed again gives the same strings in the same order. Calls from
+// several threads at once each get a different number, but which thread gets which depends on
+// timing, so a reproducible sequence is generated from one thread, or from engines the callers
+// pass in. Links are drawn from in order of the linked words' ids however they were added, and a
+// saved chain keeps its ids, so the chain loaded from its file gives the same strings, and so does
+// a snapshot of either in SAMPLE_CUMULATIVE mode.
+void MarkovChain::setSeed(unsigned long long seed)
 {
-	ifstream chainFile(fileName.c_str(), ios::in);
-	if(chainFile.is_open())
-	{
-		clear();
-		unserialize(chainFile);
-		chainFile.close();
-	}
+	seeded = true;
+	generationSeed = seed;
+	seededCalls = 0;
 }
 
 
-// Saves the MarkovChain into the given file by calling the serialize method
-void MarkovChain::save(string fileName)
+// Goes back to generating from each calling thread's own engine when none is given
+void MarkovChain::clearSeed()
 {
-	ofstream saveFile(fileName.c_str(), ios::out | ios::trunc);
-	if(saveFile.is_open())
-	{
-		serialize(saveFile);
-		saveFile.close();
-	}
+	seeded = false;
 }
 
 
-// Removes all words from the dictionary and reinitializes start and end.
-void MarkovChain::clear()
+// Returns whether generation without an engine is seeded by the chain
+bool MarkovChain::isSeeded() const
 {
-	// Clean up by deleting all of the Words. Each Word deletes its own set of links
-	auto i = dictionary.begin();
-	for(i; i != dictionary.end(); i++)
-		delete i->second;
+	return seeded;
+}
 
-	initTerminators();
+
+// Returns the probability the chain gives the given text, as a language model of the corpus:
+// the chance that generating from the start of a sentence, with the default policy, gives
+// each sentence of the text in turn. Text is split into sentences as addText splits it, so a
+// text of several sentences is scored as a document, and every word and sentence end is a
+// prediction. Any word the chain doesn't have gives the text a probability of 0.
+SentenceScore MarkovChain::scoreSentence(string_view text) const
+{
+	return scoreSentence(text, 0);
 }
 
 
-// Add text to the chain's corpus. The text should have space delimited sentences
-void MarkovChain::addText(string text)
+// Returns the probability the chain gives the given text with add-k smoothing: the given k is
+// added to the count of every word that could follow each word, so that words and links the
+// chain has never seen make a text less likely rather than impossible
+SentenceScore MarkovChain::scoreSentence(string_view text, double smoothing) const
 {
-	// Find the index of end of the first sentence
-	int period = text.find('.');
+	SentenceScore score;
 
-	// The index of end of the previous sentence (start of the current)
-	int lastPeriod = 0;
+	scoreText(text, smoothing, score);
+	score.finish();
 
-	if(period == -1)
-		period = text.length() - 1;
+	return score;
+}
 
-	// For each sentence in the text
-	while(period != string::npos && period >= 0)
-	{
-		if(text[lastPeriod] == '.')
-			lastPeriod++;
 
-		// Pull out the text between the two period index
-		string line = text.substr(lastPeriod, period - lastPeriod + 1);
+// Sets whether a seed word that isn't in the chain as written matches the most common word
+// that differs from it only in case. The lower case form of every word is kept while it's
+// on, so matching costs one more lookup per missed seed word and nothing else.
+void MarkovChain::setCaseFolding(bool fold)
+{
+	caseFolding = fold;
 
-		// Find the next sentence boundaries for the next iteration
-		lastPeriod = period;
-		period = text.find('.', period + 1);
+	foldedDictionary.clear();
+	vector<WordId>().swap(foldedFirst);
+	vector<WordId>().swap(foldedNext);
+
+	if(fold)
+	{
+		for(unsigned int i = 0; i < words.size(); i++)
+			addFolded(i);
+	}
+}
 
-		// Tokenize the sentence, splitting it into words
-		vector<string> words = tokenize(line, order);
 
-		// If there are no words in the sentence (elipses, for example), immediately
-		// skip to the next sentence
-		if(words.size() == 0)
-			continue;
+// Returns whether seeds are matched ignoring case
+bool MarkovChain::getCaseFolding() const
+{
+	return caseFolding;
+}
+
 
-		// The current word in the sentence's sequence being analyzed. Initially
-		// set to the start word so that links to words commonly starting sentences
-		// can be found.
-		Word* word = start;
+// Removes rare links to bound the chain's memory. A link between two words is removed if it
+// was seen fewer than minCount times, or if it isn't among the maxFanout most common links
+// of either word in its direction. Runs of words lose the words seen next to them in the same
+// way. Words left with no links at all are removed. A maxFanout of 0 keeps any number.
+//
+// Random words are drawn against the counts of the links that remain, so generation stays
+// correct, though it can now reach a word with no way onward, which ends the string there.
+// The whole chain is rebuilt afterwards, which renumbers the words and returns the memory
+// the removed links and words held, so pruning takes about as long as saving and loading.
+void MarkovChain::prune(int minCount, int maxFanout)
+{
+	// Each link is in both of the words it joins, so both copies are removed together
+	vector<Word*> weak;
+	int directions[2] = {GENERATE_POSTFIX, GENERATE_PREFIX};
 
-		// In order to generate random words quickly, the number of times the word
-		// occurrs is needed. Since start never actually occurs, it must be set
-		// to occurr artificially.
-		word->addOccurrence();
+	for(int d = 0; d < 2; d++)
+	{
+		int opposite = (directions[d] == GENERATE_POSTFIX) ? GENERATE_PREFIX : GENERATE_POSTFIX;
 
-		// For each word in the sentence
 		for(unsigned int i = 0; i < words.size(); i++)
 		{
-			// Another, probably unnecessary, check for empty words
-			if(words[i].length() == 0)
-				continue;
+			weak.clear();
+			words[i]->findWeakLinks(directions[d], minCount, maxFanout, weak);
+
+			for(unsigned int j = 0; j < weak.size(); j++)
+			{
+				words[i]->removeLink(weak[j]->getId(), directions[d]);
+				weak[j]->removeLink(words[i]->getId(), opposite);
+			}
+		}
+	}
+
+	vector<bool> removed(words.size(), false);
+	for(unsigned int i = 0; i < words.size(); i++)
+		removed[i] = words[i]->getLinks().empty() && words[i] != start && words[i] != end;
+
+	if(order > 1)
+	{
+		postfixGrams.prune(minCount, maxFanout, removed);
+		prefixGrams.prune(minCount, maxFanout, removed);
+	}
+
+	// Rebuild the chain from a snapshot of what's left, which leaves out the removed words
+	FrozenChain image(*this);
+	clear();
+	addImage(image);
+}
+
+
+// Sets the most memory the chain may use, as getMemoryUsage counts it. When adding text takes
+// the chain past it, the rarest links are pruned until the chain is back under
+// MEMORY_BUDGET_TARGET percent of it. A budget of 0, the default, never prunes.
+void MarkovChain::setMemoryBudget(size_t bytes)
+{
+	memoryBudget = bytes;
+	enforceBudget();
+}
 
-			// Pull the Word object for the next textual word from the dictionary
-			Word* nextWord;
 
-			// If the word is not in the dictionary, add it
-			if(dictionary.find(words[i]) == dictionary.end())
-				dictionary[words[i]] = new Word(words[i], this);
+// Returns the number of bytes the chain holds for its words, links, runs of words and the
+// sentences waiting for a checkpoint. Sampling tables are not counted.
+size_t MarkovChain::getMemoryUsage() const
+{
+	size_t shareBytes = 0;
+	for(unsigned int i = 0; i < shareArenas.size(); i++)
+		shareBytes += shareArenas[i]->getMemoryUsage();
+
+	return arena.getMemoryUsage()
+		+ shareBytes
+		+ dictionary.getMemoryUsage()
+		+ words.capacity() * sizeof(Word*)
+		+ postfixGrams.getMemoryUsage()
+		+ prefixGrams.getMemoryUsage()
+		+ foldedDictionary.getMemoryUsage()
+		+ (foldedFirst.capacity() + foldedNext.capacity()) * sizeof(WordId)
+		+ pendingSentences.capacity() * sizeof(WordId)
+		+ logNumbers.capacity() * sizeof(unsigned int);
+}
 
-			nextWord = dictionary[words[i]];
 
-			// Examining this word implies it has occurred again in the corpus.
-			// Increment its count of occurrences
-			nextWord->addOccurrence();
+// Returns what the chain holds, and what it has done since it was made or resetStats was
+// called. Clearing, loading or pruning the chain changes what it holds, but not what it has
+// done. Counting the links and bytes of text visits every word, so this takes time in
+// proportion to the words. Any thread may call this at any time the chain's size may be read.
+ChainStats MarkovChain::getStats() const
+{
+	ChainStats snapshot;
 
-			// The nextWord value comes after word in the sentence sequence, therefore
-			// nextWord is a postfix of word. Add it as such, so nextWord becomes
-			// a possiblity to follow word when generating the final string.
-			word->addPostfix(nextWord);
-			nextWord->addPrefix(word);
+#ifdef MARQOV_STATS
+	stats.collect(snapshot);
+#endif
 
-			// The following word of the sequence comes after nextWord, so nextWord
-			// assumes the role of its predecessor
-			word = nextWord;
-		}
+	// The start and end words aren't words of the corpus
+	snapshot.words = words.size() - 2;
 
-		// Add the end to the final word in the sequence to mark it as a possible
-		// ending point for sentences (because by definition nothing follows end).
-		if(word != start)
-		{
-			word->addPostfix(end);
-			end->addPrefix(word);
-		}
+	for(unsigned int i = 0; i < words.size(); i++)
+	{
+		snapshot.links += words[i]->getFanout(GENERATE_POSTFIX);
+		snapshot.textBytes += words[i]->getText().length();
 	}
+
+	snapshot.memoryBytes = getMemoryUsage();
+	return snapshot;
 }
 
 
-// Sets the number of words to group together when forming the dictionary
-void MarkovChain::setOrder(int order)
+// Sets every counter and histogram of the stats back to 0
+void MarkovChain::resetStats()
 {
-	this->order = order;
+#ifdef MARQOV_STATS
+	stats.reset();
+#endif
 }
 
 
 // Generates a semi-random string using the chain data structure generated from
 // the given text corpus. No more than maxWordCount words will be included in the
-// returned string, but fewer words is possible, should the end word be chosen
-string MarkovChain::generateString(int direction, Word* seed, int maxWordCount)
+// returned string, but fewer words is possible, should the end word be chosen.
+// Uses the calling thread's random engine, or an engine seeded with the chain's seed.
+string MarkovChain::generateString(int direction, Word* seed, int maxWordCount) const
 {
-	// A list of word to be concatenated to form the final string
-	list<Word*> randomWords;
-
-	// References to words generated in prefix (ws) and postfix (we) directions
-	Word* ws = seed;
-	Word* we = seed;
+	Random engine;
+	return generateString(direction, seed, maxWordCount, getEngine(engine));
+}
 
-	// The string that will be returned. It will contain the values in randomWords
-	// separated by spaces.
-	string finalString;
 
-	// Flags representing the directions to generate words. These are set to false when an endpoint
-	// word in reached in either direction. Generation is finished when both are true
-	bool startReached = (direction & GENERATE_PREFIX) == 0 || ws == start;
-	bool endReached = (direction & GENERATE_POSTFIX) == 0 || we == end;
+// Generates a semi-random string as above, drawing every random choice from the given engine
+string MarkovChain::generateString(int direction, Word* seed, int maxWordCount, Random& random) const
+{
+	GenerationBuffer& buffer = GenerationBuffer::local();
+	buffer.clear();
+	appendString(direction, seed, maxWordCount, buffer, random);
 
-	// Start with the seed. The string will grow in both directions from here
-	randomWords.push_back(seed);
+	return string(buffer.getString(0));
+}
 
-	// Continue until the maximum number of words is reached, or an ending point
-	// is encountered
-	for(int i = 0; i < maxWordCount;)
-	{
-		// If both ends of the string have been reached, we're done collecting random words
-		if(startReached && endReached)
-			break;
 
-		// If the start word hasn't been encountered, choose a random prefix and add it to the
-		// front of randomWords
-		if(!startReached)
-		{
-			ws = ws->getRandomPrefix();
-			randomWords.push_front(ws);
-			i++;
+// Generates a semi-random sentence using a pre-made sentence as a seed. A random
+// word of the seed that is in the dictionary is used to generate a sentence around
+// it, or start if none is. Uses the calling thread's random engine, or an engine seeded
+// with the chain's seed.
+string MarkovChain::generateString(string seed, int maxWordCount) const
+{
+	Random engine;
+	return generateString(seed, maxWordCount, getEngine(engine));
+}
 
-			// Once start is reached, don't generate anymore prefixes
-			if(ws == start)
-				startReached = true;
-		}
 
-		// If the end word hasn't been encountered, choose a random postfix and add it to the
-		// end of randomWords
-		if(!endReached)
-		{
-			we = we->getRandomPostfix();
-			randomWords.push_back(we);
-			i++;
+// Generates a semi-random sentence around a word of the seed, drawing every random
+// choice from the given engine
+string MarkovChain::generateString(string seed, int maxWordCount, Random& random) const
+{
+	return generateString(GENERATE_BOTH, findSeed(seed, random), maxWordCount, random);
+}
 
-			// Once end is reached, don't generate anymore postfixes
-			if(we == end)
-				endReached = true;
-		}
-	}
 
-	// If only generating in one direction, either start or end will be missing. Add them explicitly
-	// so they're guaranteed to be there. Multiples do nothing to the final result.
-	randomWords.push_front(start);
-	randomWords.push_back(end);
+// Generates a semi-random sentence beginning with an empty sentence start string.
+// Uses the calling thread's random engine, or an engine seeded with the chain's seed.
+string MarkovChain::generateString(int maxWordCount) const
+{
+	Random engine;
+	return generateString(GENERATE_POSTFIX, start, maxWordCount, getEngine(engine));
+}
 
-	// For each word in the list of words to use, add the text and a space to
-	// the final string
-	auto i = randomWords.begin();
-	for(i; i != randomWords.end(); i++)
-	{
-		if(*i != end && *i != start)
-		{
-			finalString.append((*i)->getText());
-			finalString.append(" ");
-		}
-	}
 
-	return finalString;
+// Generates a semi-random sentence beginning with an empty sentence start string,
+// drawing every random choice from the given engine
+string MarkovChain::generateString(int maxWordCount, Random& random) const
+{
+	return generateString(GENERATE_POSTFIX, start, maxWordCount, random);
 }
 
 
-// Generates a semi-random sentence using a pre-made sentence as a seed. A random
-// word is chosen from the seed and, if it's in the dictionary, used to generate
-// a sentence around it.
-string MarkovChain::generateString(string seed, int maxWordCount)
+// Generates the given number of semi-random sentences, each beginning with the start
+// word, and adds them to the end of the buffer. Uses the calling thread's random engine, or
+// an engine seeded with the chain's seed, which the whole batch draws from in turn.
+void MarkovChain::generateBatch(int count, int maxWordCount, GenerationBuffer& buffer) const
 {
-	// Split the seed into separate words
-	vector<string> seedWords = tokenize(seed, order);
+	Random engine;
+	generateBatch(count, maxWordCount, buffer, getEngine(engine));
+}
 
-	// Select a random word from the seed and take it from the dictionary if it exists
-	Word* seedWord = NULL;
 
-	// Try 5 times to find a seed word in the dictionary. Stop if one is found
-	if(seedWords.size() > 0)
-	{
-		for(int i = 0; i < 5; i++)
-		{
-			int randomIndex = rand() % seedWords.size();
-			string randomSeed = seedWords[randomIndex];
+// Generates the given number of semi-random sentences into the buffer, drawing every random
+// choice from the given engine. Each sentence is the same as generateString(maxWordCount)
+// would return, but reusing one buffer for every batch avoids allocating for each sentence.
+void MarkovChain::generateBatch(int count, int maxWordCount, GenerationBuffer& buffer, Random& random) const
+{
+	for(int i = 0; i < count; i++)
+		appendString(GENERATE_POSTFIX, start, maxWordCount, buffer, random);
+}
 
-			// If the word exists, use it as the seed
-			if(dictionary.find(randomSeed) != dictionary.end())
-			{
-				seedWord = dictionary[randomSeed];
-				break;
-			}
-		}
-	}
 
-	// If it's not in the dictionary, just use the start word
-	if(seedWord == NULL)
-		seedWord = start;
+// Returns the Word object that has the given text, or NULL if there is no such Word
+Word* MarkovChain::getWord(string text) const
+{
+	WordId id = dictionary.find(text);
+	if(id == NO_WORD)
+		return NULL;
 
-	return generateString(GENERATE_BOTH, seedWord, maxWordCount);
+	return words[id];
 }
 
 
-// Generates a semi-random sentence beginning with an empty sentence start string
-string MarkovChain::generateString(int maxWordCount)
+// Returns a compact, read-only snapshot of the chain. The snapshot generates the same kind
+// of strings, but does not see text added to the chain afterward.
+FrozenChain MarkovChain::freeze() const
 {
-	return generateString(GENERATE_POSTFIX, start, maxWordCount);
+	return FrozenChain(*this);
 }
 
 
-// Returns the Word object that has the given text
-Word* MarkovChain::getWord(string text)
+// Returns a snapshot of the chain with its links stored in the given format. Packed links
+// take a fraction of the memory of plain ones, at some cost to generation speed.
+FrozenChain MarkovChain::freeze(int edgeFormat) const
 {
-	return dictionary[text];
+	return FrozenChain(*this, edgeFormat);
 }
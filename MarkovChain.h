@@ -24,28 +24,81 @@
 #define GENERATE_POSTFIX 2
 #define GENERATE_BOTH 3
 
+#define SAMPLE_CUMULATIVE 1
+#define SAMPLE_ALIAS 2
+
+// The mode SAMPLE_CUMULATIVE replaced, which walked every link of a word on each call
+#define SAMPLE_LINEAR SAMPLE_CUMULATIVE
+
+// The number of bytes addStream reads at a time, and the longest run of text without a
+// period it will hold on to while looking for the end of a sentence
+#define STREAM_CHUNK_SIZE 65536
+#define MAX_SENTENCE_LENGTH 1048576
+
+// checkpoint rewrites the whole chain file once its log grows past this many times its size
+#define CHECKPOINT_COMPACT_RATIO 1
+
+// The percentage of its memory budget a chain that outgrew it is pruned down to, so that it
+// isn't pruned again by the next few sentences
+#define MEMORY_BUDGET_TARGET 75
+
+// The step between the seeds of consecutive seeded calls. Random::seed steps its own state by
+// the golden ratio, so an odd number unrelated to it keeps the engines of nearby calls apart
+#define SEED_CALL_STRIDE 0xd1b54a32d192ed03ULL
+
+#include "Arena.h"
+#include "Dictionary.h"
+#include "NGramTable.h"
+#include "Random.h"
+#include "ChainStats.h"
+#include "GenerationPolicy.h"
+#include "SentenceScore.h"
+#include "StatsRecorder.h"
 #include <vector>
 #include <map>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <iostream>
+#include <atomic>
 
 class Word;
+class FrozenChain;
+class ChainShard;
+class GenerationBuffer;
 
 using namespace std;
 
 // This class generates a Markov chain of textual words. The chain is created by
 // the sequence of words for each sentence in the given corpus. It is designed
 // to generate semi-random text strings using the probabilities of the following words.
+//
+// Generating never changes the chain, so once the corpus is loaded any number of threads
+// may generate from one chain at once. Each thread draws from its own Random engine,
+// either one it passes in or its own thread-local engine. Adding text, loading, clearing
+// or changing the order or sampling mode must not happen while other threads generate.
 class MarkovChain
 {
+	friend class FrozenChain;
+	friend class Word;
+
 private:
 	// Text identifiers for the start and end words
 	const static char startText[2];
 	const static char endText[2];
 
-	// Central repository for Words in the corpus, keyed by the text of the Word
-	map<string, Word*> dictionary;
+	// Central repository for the text of Words in the corpus. Gives each text its WordId
+	Dictionary dictionary;
+
+	// Holds every Word and every node of their links, so that the whole chain is freed at once
+	Arena arena;
+
+	// Hold the links of the Words created by loading on several threads, one arena for each
+	// thread's share of the Words, since an Arena can't be used by several threads at once
+	vector<Arena*> shareArenas;
+
+	// The Word for each WordId in the dictionary. The Words are in the arena
+	vector<Word*> words;
 
 	// A dummy word that is used to indicate the start of a sentence. This is added
 	// to each sentence before the first word is added.
@@ -55,21 +108,96 @@ private:
 	// end of a sentence sequence.
 	Word* end;
 
-	// The number of real words to compare as a single token
+	// The number of words before a word that determine how likely it is to come next
 	int order;
 
-	void initTerminators(int, int);
-	void initTerminators();
+	// For an order above 1, the words seen after and before each run of order words. Every
+	// order also keeps single word links in the Words, which generation falls back on when
+	// it doesn't yet know order words, or knows a run of them that was never seen.
+	NGramTable postfixGrams;
+	NGramTable prefixGrams;
+
+	// The ids of the sentence being added, reused by addSentence
+	vector<WordId> sentenceIds;
+
+	// The chain file whose log the sentences added since it was written go to, or empty when
+	// sentences aren't being recorded. Also the sizes of its image and of its log, as far as
+	// checkpoint has written them
+	string checkpointName;
+	size_t checkpointSize;
+	size_t logSize;
+
+	// The ids of the sentences added since the last checkpoint, each followed by NO_WORD
+	vector<WordId> pendingSentences;
+
+	// The most bytes the chain may use before its rarest links are pruned, or 0 for no limit
+	size_t memoryBudget;
+
+	// The number of each word in the log record being written, by WordId, or
+	// LOG_SENTENCE_END. Only the words of the record are set, and they are reset after it
+	vector<unsigned int> logNumbers;
+
+	// Whether seeds that match no word exactly are matched ignoring case. If so, the lower
+	// case form of every word is kept, with the first word of each form by the id of the form,
+	// and the next word of the same form by the id of each word.
+	bool caseFolding;
+	Dictionary foldedDictionary;
+	vector<WordId> foldedFirst;
+	vector<WordId> foldedNext;
+
+#ifdef MARQOV_STATS
+	// What the chain has done since it was made or its stats were reset. Generating counts
+	// too, so the recorder changes even when the chain doesn't
+	mutable StatsRecorder stats;
+#endif
+
+	// How Words choose a random prefix or postfix. SAMPLE_CUMULATIVE searches a table of running
+	// totals per Word that is kept up to date as text is added, SAMPLE_ALIAS builds an alias
+	// table per Word on first use and samples in constant time until the Word's counts change
+	int samplingMode;
+
+	// How generation chooses each next word, or finds whole strings by beam search
+	GenerationPolicy policy;
+
+	// Whether generation without an engine of the caller's draws from a new engine seeded with
+	// generationSeed and the number of such calls made since the seed was set, rather than from
+	// the calling thread's own engine. Each call draws a different string, and the calls after
+	// setSeed give the same strings in the same order every time. Words and runs of words draw
+	// from their links in order of the linked words' ids, which saving keeps, so a chain gives
+	// the same strings for a seed as the chain loaded from its file, and in SAMPLE_CUMULATIVE
+	// mode as a FrozenChain of either.
+	bool seeded;
+	unsigned long long generationSeed;
+	mutable atomic<unsigned long long> seededCalls;
 
-	void serialize(ofstream&);
-	void unserialize(ifstream&);
+	void initTerminators();
+	void release();
+	Word* addWord(string_view);
+	Word* addWord(string_view, Arena*);
+
+	void addSentence(const string_view*, unsigned int);
+	void addSentences(const vector<string_view>&, const vector<unsigned int>&);
+	void stopRecording();
+	void addImage(const FrozenChain&);
+	void addImage(const FrozenChain&, int);
+	void enforceBudget();
+	void mergeShard(ChainShard&);
+	void addFolded(WordId);
+	Word* findSeed(string_view, Random&) const;
+	void scoreText(string_view, double, SentenceScore&) const;
+	Word* getRandomNext(int, Word*, bool, GenerationBuffer&, Random&) const;
+	bool getBeamContext(int, int, bool, GenerationBuffer&) const;
+	int searchBeam(int, Word*, bool, int, GenerationBuffer&, bool&) const;
+	void appendString(int, Word*, int, GenerationBuffer&, Random&) const;
+	Random& getEngine(Random&) const;
 
 	// Utility methods
-	void cleanTokens(vector<string>&);
-	vector<string> tokenize(string, int);
-	bool isWhitespace(char);
-	bool isWhitespace(string);
-	bool isLetter(char);
+	static void splitSentences(string_view, vector<string_view>&);
+	static void foldCase(string_view, string&);
+	static void cleanTokens(vector<string_view>&);
+	static void tokenize(string_view, vector<string_view>&);
+	static bool isWhitespace(char);
+	static bool isLetter(char);
 
 public:
 	MarkovChain();
@@ -77,17 +205,51 @@ public:
 	~MarkovChain();
 
 	// Saving and loading methods
-	void load(string);
+	bool load(string);
+	bool load(string, int);
 	void save(string);
+	void save(string, int);
+	bool checkpoint(string);
+	bool compact(string);
 	void clear();
 
-	void addText(string);
+	void addText(string_view);
+	void addStream(istream&);
+	bool addFile(string);
+	void addTexts(const vector<string>&, int);
+	bool merge(const MarkovChain&);
+	bool merge(const FrozenChain&);
 	void setOrder(int);
-	string generateString(int, Word*, int);
-	string generateString(string, int);
-	string generateString(int);
-
-	Word* getWord(string);
+	int getOrder() const;
+	void setSamplingMode(int);
+	int getSamplingMode() const;
+	void setGenerationPolicy(const GenerationPolicy&);
+	const GenerationPolicy& getGenerationPolicy() const;
+	void setSeed(unsigned long long);
+	void clearSeed();
+	bool isSeeded() const;
+	SentenceScore scoreSentence(string_view) const;
+	SentenceScore scoreSentence(string_view, double) const;
+	void setCaseFolding(bool);
+	bool getCaseFolding() const;
+	void prune(int, int);
+	void setMemoryBudget(size_t);
+	size_t getMemoryUsage() const;
+	ChainStats getStats() const;
+	void resetStats();
+	string generateString(int, Word*, int) const;
+	string generateString(int, Word*, int, Random&) const;
+	string generateString(string, int) const;
+	string generateString(string, int, Random&) const;
+	string generateString(int) const;
+	string generateString(int, Random&) const;
+	void generateBatch(int, int, GenerationBuffer&) const;
+	void generateBatch(int, int, GenerationBuffer&, Random&) const;
+
+	Word* getWord(string) const;
+
+	FrozenChain freeze() const;
+	FrozenChain freeze(int) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,63 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Merge.cpp: Command line tool that combines saved chains into one.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MarkovChain.h"
+#include <cstdio>
+#include <thread>
+
+// Usage: marqov_merge output input...
+//
+// Loads each input chain file, along with its checkpoint log if it has one, adds its counts
+// to the output and saves the output once all of them are merged. Only one input is held in
+// memory at a time besides the merged chain, so any number of them can be combined. Every
+// input must have the same order. Files are read and written on every core of the machine.
+int main(int argc, char** argv)
+{
+	if(argc < 3)
+	{
+		printf("Usage: %s output input...\n", argv[0]);
+		return 1;
+	}
+
+	int threadCount = thread::hardware_concurrency();
+	if(threadCount < 1)
+		threadCount = 1;
+
+	MarkovChain merged;
+
+	for(int i = 2; i < argc; i++)
+	{
+		MarkovChain input;
+		if(!input.load(argv[i], threadCount))
+		{
+			fprintf(stderr, "%s: can't read a chain from %s\n", argv[0], argv[i]);
+			return 1;
+		}
+
+		if(!merged.merge(input))
+		{
+			fprintf(stderr, "%s: %s has order %d, but the chains before it have order %d\n",
+				argv[0], argv[i], input.getOrder(), merged.getOrder());
+			return 1;
+		}
+	}
+
+	merged.save(argv[1], threadCount);
+	return 0;
+}
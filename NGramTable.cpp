@@ -0,0 +1,611 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * NGramTable.cpp: Definition of the NGramTable class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "NGramTable.h"
+#include "MarkovChain.h"
+#include "CumulativeTable.h"
+#include <algorithm>
+
+// The number of slots in a new hash table
+#define NGRAM_MIN_SLOTS 16
+
+// Marks an empty slot of a context's index
+#define NO_EDGE -1
+
+// Spreads the ids of a context's words over its index. Ids are handed out in order, so an odd
+// multiplier is enough to keep neighbouring ids apart.
+#define NGRAM_INDEX_HASH 0x9e3779b1u
+
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
+
+
+// Returns the slot holding the given context, or the empty slot where it would go if it
+// isn't in the table. Collisions are resolved by linear probing.
+size_t NGramTable::findSlot(const WordId* context, unsigned int h) const
+{
+	size_t mask = slots.size() - 1;
+	size_t i = h & mask;
+
+	while(slots[i] != NO_CONTEXT)
+	{
+		int number = slots[i];
+		if(hashes[number] == h)
+		{
+			const WordId* key = &keys[(size_t)number * order];
+
+			int j = 0;
+			while(j < order && key[j] == context[j])
+				j++;
+
+			if(j == order)
+				return i;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
+
+
+// Returns the position of the given word among the edges of the context with the given
+// number, or NO_EDGE if it has never been seen with it. Small contexts are walked, and the
+// rest are looked up in their index.
+int NGramTable::findEdge(int number, WordId word) const
+{
+	const vector<NGramEdge>& contextEdges = edges[number];
+	const vector<int>* index = indexes[number];
+
+	if(index == NULL)
+	{
+		for(unsigned int i = 0; i < contextEdges.size(); i++)
+		{
+			if(contextEdges[i].word == word)
+				return i;
+		}
+
+		return NO_EDGE;
+	}
+
+	size_t mask = index->size() - 1;
+	size_t i = ((unsigned int)word * NGRAM_INDEX_HASH) & mask;
+
+	while((*index)[i] != NO_EDGE)
+	{
+		if(contextEdges[(*index)[i]].word == word)
+			return (*index)[i];
+
+		i = (i + 1) & mask;
+	}
+
+	return NO_EDGE;
+}
+
+
+// Puts the position of the given word in the first free slot of the index from its own. The
+// index must have a free slot.
+void NGramTable::indexEdge(vector<int>& index, WordId word, int position)
+{
+	size_t mask = index.size() - 1;
+	size_t i = ((unsigned int)word * NGRAM_INDEX_HASH) & mask;
+
+	while(index[i] != NO_EDGE)
+		i = (i + 1) & mask;
+
+	index[i] = position;
+}
+
+
+// Builds the index of the context with the given number, with room for it to double its words
+// before it must be built again
+void NGramTable::buildIndex(int number)
+{
+	const vector<NGramEdge>& contextEdges = edges[number];
+
+	size_t slotCount = NGRAM_MIN_SLOTS;
+	while(slotCount < 4 * contextEdges.size())
+		slotCount *= 2;
+
+	if(indexes[number] == NULL)
+		indexes[number] = new vector<int>();
+
+	vector<int>& index = *indexes[number];
+	index.assign(slotCount, NO_EDGE);
+
+	for(unsigned int i = 0; i < contextEdges.size(); i++)
+		indexEdge(index, contextEdges[i].word, i);
+}
+
+
+// Deletes the sampling table and ranked words of every context. They are rebuilt when next needed
+void NGramTable::discardTables()
+{
+	for(unsigned int i = 0; i < sums.size(); i++)
+	{
+		delete sums[i].exchange(NULL);
+		delete ranks[i].exchange(NULL);
+	}
+}
+
+
+// Doubles the number of slots and puts every context back in its new slot
+void NGramTable::grow()
+{
+	rehash(slots.empty() ? NGRAM_MIN_SLOTS : slots.size() * 2);
+}
+
+
+// Replaces the slots with the given number of them, a power of two larger than the number
+// of contexts, and puts every context in its slot
+void NGramTable::rehash(size_t slotCount)
+{
+	slots.assign(slotCount, NO_CONTEXT);
+
+	size_t mask = slotCount - 1;
+	for(int number = 0; number < (int)hashes.size(); number++)
+	{
+		size_t i = hashes[number] & mask;
+		while(slots[i] != NO_CONTEXT)
+			i = (i + 1) & mask;
+
+		slots[i] = number;
+	}
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty table of order 1
+NGramTable::NGramTable()
+{
+	order = 1;
+	edgeCount = 0;
+}
+
+
+// Deletes the indexes and sampling tables, if any were built
+NGramTable::~NGramTable()
+{
+	clear();
+}
+
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Public Static Members ------------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Hashes a context of the given number of ids. FrozenChain uses the same hash for the
+// contexts in its image, so it must not change without changing the image version.
+unsigned int NGramTable::hash(const WordId* context, int order)
+{
+	unsigned long long h = 0xcbf29ce484222325ULL;
+
+	for(int i = 0; i < order; i++)
+	{
+		h = (h ^ (unsigned int)context[i]) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+
+	// Fold the well mixed upper bits down, since the table is indexed by the lower ones
+	h *= 0x9e3779b97f4a7c15ULL;
+	return (unsigned int)(h >> 32);
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Sets the number of ids in a context. This removes every context, since their keys
+// would no longer be the right length.
+void NGramTable::setOrder(int order)
+{
+	clear();
+	this->order = order;
+}
+
+
+// Returns the number of ids in a context
+int NGramTable::getOrder() const
+{
+	return order;
+}
+
+
+// Counts the given word the given number of times next to the given context, adding the
+// context if it's new
+void NGramTable::add(const WordId* context, WordId word, int count)
+{
+	// Keep at most half of the slots full so that probe sequences stay short
+	if(slots.size() < 2 * (hashes.size() + 1))
+		grow();
+
+	unsigned int h = hash(context, order);
+	size_t slot = findSlot(context, h);
+	int number = slots[slot];
+
+	if(number == NO_CONTEXT)
+	{
+		number = hashes.size();
+		keys.insert(keys.end(), context, context + order);
+		hashes.push_back(h);
+		edges.push_back(vector<NGramEdge>());
+		totals.push_back(0);
+		indexes.push_back(NULL);
+		sums.emplace_back((CumulativeTable*)NULL);
+		ranks.emplace_back((vector<NGramEdge>*)NULL);
+		slots[slot] = number;
+	}
+
+	totals[number] += count;
+
+	// The sampling table follows the count, but the ranked words no longer reflect it
+	CumulativeTable* table = sums[number].load();
+	if(table != NULL)
+		table->add(word, count);
+
+	if(ranks[number].load() != NULL)
+		delete ranks[number].exchange(NULL);
+
+	vector<NGramEdge>& contextEdges = edges[number];
+	int i = findEdge(number, word);
+
+	if(i == NO_EDGE)
+	{
+		i = contextEdges.size();
+
+		NGramEdge edge;
+		edge.word = word;
+		edge.count = 0;
+		contextEdges.push_back(edge);
+		edgeCount++;
+
+		// Index the words once there are too many to walk, keeping at least half of the index free
+		vector<int>* index = indexes[number];
+		if(contextEdges.size() > NGRAM_INDEX_EDGES)
+		{
+			if(index == NULL || index->size() < 2 * contextEdges.size())
+				buildIndex(number);
+			else
+				indexEdge(*index, word, i);
+		}
+	}
+
+	contextEdges[i].count += count;
+}
+
+
+// Counts every n-gram of one sentence of ids. For GENERATE_POSTFIX the sentence is padded
+// with order start ids before it and an end id after it, and each id is counted after the
+// order ids before it. For GENERATE_PREFIX the sentence is padded with a start id before it
+// and order end ids after it, and each id is counted before the order ids after it.
+void NGramTable::addSentence(const vector<WordId>& sentence, WordId start, WordId end, int direction)
+{
+	if(sentence.size() == 0)
+		return;
+
+	padded.clear();
+
+	if(direction == GENERATE_POSTFIX)
+	{
+		padded.insert(padded.end(), order, start);
+		padded.insert(padded.end(), sentence.begin(), sentence.end());
+		padded.push_back(end);
+
+		for(unsigned int i = 0; i + order < padded.size(); i++)
+			add(&padded[i], padded[i + order], 1);
+	}
+	else
+	{
+		padded.push_back(start);
+		padded.insert(padded.end(), sentence.begin(), sentence.end());
+		padded.insert(padded.end(), order, end);
+
+		for(unsigned int i = 0; i + order < padded.size(); i++)
+			add(&padded[i + 1], padded[i], 1);
+	}
+}
+
+
+// Returns the number of the given context, or NO_CONTEXT if it has never been seen
+int NGramTable::find(const WordId* context) const
+{
+	if(slots.empty())
+		return NO_CONTEXT;
+
+	return slots[findSlot(context, hash(context, order))];
+}
+
+
+// Chooses a random word seen next to the context with the given number, weighted by count.
+// The context's table is built the first time it's sampled, and when several threads build
+// it at once, the first one published is kept.
+WordId NGramTable::sample(int number, Random& random) const
+{
+	CumulativeTable* table = sums[number].load(memory_order_acquire);
+
+	if(table == NULL)
+	{
+		CumulativeTable* built = new CumulativeTable(edges[number]);
+		if(sums[number].compare_exchange_strong(table, built, memory_order_acq_rel, memory_order_acquire))
+			table = built;
+		else
+			delete built;
+	}
+
+	return table->sample(random);
+}
+
+
+// Returns the words seen next to the context with the given number from most to least common,
+// those seen equally often in order of id. They are ranked the first time they're needed after
+// the context's counts change, and when several threads rank them at once, the first list
+// published is kept.
+const vector<NGramEdge>& NGramTable::getRanks(int number) const
+{
+	vector<NGramEdge>* ranked = ranks[number].load(memory_order_acquire);
+
+	if(ranked == NULL)
+	{
+		vector<NGramEdge>* built = new vector<NGramEdge>(edges[number]);
+		sort(built->begin(), built->end(), [](const NGramEdge& a, const NGramEdge& b)
+		{
+			return (a.count != b.count) ? a.count > b.count : a.word < b.word;
+		});
+
+		if(ranks[number].compare_exchange_strong(ranked, built, memory_order_acq_rel, memory_order_acquire))
+			ranked = built;
+		else
+			delete built;
+	}
+
+	return *ranked;
+}
+
+
+// Returns the number of times the given word was seen next to the context with the given
+// number, or 0 if it never was
+int NGramTable::getCount(int number, WordId word) const
+{
+	int i = findEdge(number, word);
+	return (i == NO_EDGE) ? 0 : edges[number][i].count;
+}
+
+
+// Returns the sum of the counts of the words seen next to the context with the given number
+int NGramTable::getTotal(int number) const
+{
+	return totals[number];
+}
+
+
+// Returns the number of distinct contexts
+unsigned int NGramTable::size() const
+{
+	return hashes.size();
+}
+
+
+// Returns the number of distinct context and word pairs
+unsigned int NGramTable::getEdgeCount() const
+{
+	return edgeCount;
+}
+
+
+// Returns the ids of the context with the given number
+const WordId* NGramTable::getContext(int number) const
+{
+	return &keys[(size_t)number * order];
+}
+
+
+// Returns the words seen next to the context with the given number, in the order they were
+// first seen with it
+const vector<NGramEdge>& NGramTable::getEdges(int number) const
+{
+	return edges[number];
+}
+
+
+// Drops each context's words seen fewer than minCount times or outside its maxFanout most
+// common words, keeping those with the lower ids of words seen equally often, and every context
+// and word whose id is marked in removed. Contexts left with no words are dropped too, and the
+// rest are renumbered in their old order. A maxFanout of 0 keeps any number of words.
+void NGramTable::prune(int minCount, int maxFanout, const vector<bool>& removed)
+{
+	discardTables();
+
+	// The words of every context move, so their indexes are built again once they're in place
+	for(unsigned int i = 0; i < indexes.size(); i++)
+	{
+		delete indexes[i];
+		indexes[i] = NULL;
+	}
+
+	int kept = 0;
+	edgeCount = 0;
+
+	vector<int> counts;
+	vector<WordId> ties;
+
+	for(int number = 0; number < (int)hashes.size(); number++)
+	{
+		const WordId* key = &keys[(size_t)number * order];
+
+		bool keyRemoved = false;
+		for(int j = 0; j < order; j++)
+			keyRemoved = keyRemoved || removed[key[j]];
+
+		vector<NGramEdge>& contextEdges = edges[number];
+		if(keyRemoved)
+			contextEdges.clear();
+
+		// Find the count of the least common word within the fanout, as Word does for links
+		int floor = 0;
+		int tiesKept = 0;
+
+		if(maxFanout > 0 && (int)contextEdges.size() > maxFanout)
+		{
+			counts.clear();
+			for(unsigned int i = 0; i < contextEdges.size(); i++)
+				counts.push_back(contextEdges[i].count);
+
+			nth_element(counts.begin(), counts.begin() + maxFanout - 1, counts.end(), greater<int>());
+			floor = counts[maxFanout - 1];
+
+			tiesKept = maxFanout;
+			for(unsigned int i = 0; i < counts.size(); i++)
+			{
+				if(counts[i] > floor)
+					tiesKept--;
+			}
+		}
+
+		// Find the highest id of the words with that count that fit in the fanout, as Word keeps
+		// the lowest ids of those linked equally often
+		WordId lastTie = NO_WORD;
+
+		if(floor > 0)
+		{
+			ties.clear();
+			for(unsigned int i = 0; i < contextEdges.size(); i++)
+			{
+				if(contextEdges[i].count == floor && floor >= minCount && !removed[contextEdges[i].word])
+					ties.push_back(contextEdges[i].word);
+			}
+
+			if((int)ties.size() > tiesKept)
+			{
+				nth_element(ties.begin(), ties.begin() + tiesKept - 1, ties.end());
+				lastTie = ties[tiesKept - 1];
+			}
+		}
+
+		unsigned int edgesKept = 0;
+		int total = 0;
+
+		for(unsigned int i = 0; i < contextEdges.size(); i++)
+		{
+			int count = contextEdges[i].count;
+			if(count < minCount || count < floor || removed[contextEdges[i].word])
+				continue;
+
+			if(count == floor && lastTie != NO_WORD && contextEdges[i].word > lastTie)
+				continue;
+
+			contextEdges[edgesKept++] = contextEdges[i];
+			total += count;
+		}
+
+		contextEdges.resize(edgesKept);
+		if(edgesKept == 0)
+			continue;
+
+		// Move the context down over the ones dropped before it
+		if(kept != number)
+		{
+			copy(key, key + order, &keys[(size_t)kept * order]);
+			hashes[kept] = hashes[number];
+			edges[kept].swap(contextEdges);
+		}
+
+		totals[kept] = total;
+		edgeCount += edgesKept;
+		kept++;
+	}
+
+	keys.resize((size_t)kept * order);
+	hashes.resize(kept);
+	edges.resize(kept);
+	totals.resize(kept);
+
+	indexes.resize(kept);
+
+	while((int)sums.size() > kept)
+	{
+		sums.pop_back();
+		ranks.pop_back();
+	}
+
+	for(int number = 0; number < kept; number++)
+	{
+		if(edges[number].size() > NGRAM_INDEX_EDGES)
+			buildIndex(number);
+	}
+
+	// Put the remaining contexts back in their slots
+	size_t slotCount = NGRAM_MIN_SLOTS;
+	while(slotCount < 2 * (hashes.size() + 1))
+		slotCount *= 2;
+
+	rehash(slotCount);
+}
+
+
+// Removes every context and frees the memory that held them
+void NGramTable::clear()
+{
+	discardTables();
+	deque<atomic<CumulativeTable*> >().swap(sums);
+	deque<atomic<vector<NGramEdge>*> >().swap(ranks);
+
+	for(unsigned int i = 0; i < indexes.size(); i++)
+		delete indexes[i];
+
+	vector<vector<int>*>().swap(indexes);
+
+	vector<WordId>().swap(keys);
+	vector<unsigned int>().swap(hashes);
+	vector<vector<NGramEdge> >().swap(edges);
+	vector<int>().swap(totals);
+	vector<int>().swap(slots);
+	edgeCount = 0;
+}
+
+
+// Returns the number of bytes held by the table for keys, edges, indexes and slots. The
+// sampling tables and ranked words are not counted, only the pointers to them.
+size_t NGramTable::getMemoryUsage() const
+{
+	size_t size = keys.capacity() * sizeof(WordId)
+		+ hashes.capacity() * sizeof(unsigned int)
+		+ edges.capacity() * sizeof(vector<NGramEdge>)
+		+ totals.capacity() * sizeof(int)
+		+ indexes.capacity() * sizeof(vector<int>*)
+		+ sums.size() * sizeof(atomic<CumulativeTable*>)
+		+ ranks.size() * sizeof(atomic<vector<NGramEdge>*>)
+		+ slots.capacity() * sizeof(int);
+
+	for(unsigned int i = 0; i < edges.size(); i++)
+	{
+		size += edges[i].capacity() * sizeof(NGramEdge);
+		if(indexes[i] != NULL)
+			size += sizeof(vector<int>) + indexes[i]->capacity() * sizeof(int);
+	}
+
+	return size;
+}
@@ -0,0 +1,134 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * NGramTable.h: Declaration of the NGramTable class. Counts the words that follow each run of words.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NGRAM_TABLE_H
+#define NGRAM_TABLE_H
+
+#include "Dictionary.h"
+#include "Random.h"
+#include <vector>
+#include <deque>
+#include <atomic>
+
+class CumulativeTable;
+
+using namespace std;
+
+// Returned in place of a context number when there is no such context
+#define NO_CONTEXT -1
+
+// The most words a context holds before its words are indexed. A walk over this many is as
+// quick as a lookup in the index, which is only worth its memory for larger contexts.
+#define NGRAM_INDEX_EDGES 8
+
+// One word seen next to a context, and the number of times it was seen there
+struct NGramEdge
+{
+	WordId word;
+	int count;
+};
+
+// The transitions of an order-k chain. A context is a run of k WordIds, and the table counts
+// the words seen next to each context: after it for a postfix table, before it for a prefix
+// table. Contexts are stored once each, as k ids packed back to back, and found through an
+// open-addressing hash of those ids, so memory grows with the number of distinct n-grams and
+// a lookup costs the same no matter how much text the table has seen.
+//
+// Contexts are numbered in the order they were first added, and each context's words are kept
+// in the order they were first seen with it. The words of a context with more than
+// NGRAM_INDEX_EDGES of them are found through an index of their positions, so counting a word
+// takes the same time however many follow the context, as after the run of start words that
+// begins every sentence. Random words are drawn from a CumulativeTable of the context, which
+// holds them in order of their ids as Words hold their links, and the most common words from
+// a list of them ranked by count.
+class NGramTable
+{
+private:
+	// The number of ids in a context
+	int order;
+
+	// The ids of every context, order per context, back to back
+	vector<WordId> keys;
+
+	// The hash of each context, by context number
+	vector<unsigned int> hashes;
+
+	// The words seen next to each context, and the sum of their counts, by context number
+	vector<vector<NGramEdge> > edges;
+	vector<int> totals;
+
+	// The index of the words of each context with more than NGRAM_INDEX_EDGES of them, or NULL.
+	// An index is an open-addressing hash of the words' ids, each slot holding the position of
+	// a word among the context's edges or NO_EDGE, with at least twice as many slots as words.
+	vector<vector<int>*> indexes;
+
+	// The sampling table of each context, built the first time the context is sampled and
+	// updated as its counts change, and the context's words from most to least common, those
+	// seen equally often in order of id, built the first time they're needed and discarded when
+	// the counts change. As with Words' tables, threads racing to build one publish it with a
+	// compare and swap and the losers throw theirs away.
+	mutable deque<atomic<CumulativeTable*> > sums;
+	mutable deque<atomic<vector<NGramEdge>*> > ranks;
+
+	// The total number of edges of all contexts
+	unsigned int edgeCount;
+
+	// The hash table. Each slot holds a context number or NO_CONTEXT. The number of slots
+	// is a power of two and is kept at least twice the number of contexts.
+	vector<int> slots;
+
+	// Reused by addSentence to pad the sentence with terminators
+	vector<WordId> padded;
+
+	size_t findSlot(const WordId*, unsigned int) const;
+	int findEdge(int, WordId) const;
+	void indexEdge(vector<int>&, WordId, int);
+	void buildIndex(int);
+	void discardTables();
+	void grow();
+	void rehash(size_t);
+
+public:
+	NGramTable();
+	~NGramTable();
+
+	static unsigned int hash(const WordId*, int);
+
+	void setOrder(int);
+	int getOrder() const;
+
+	void add(const WordId*, WordId, int);
+	void addSentence(const vector<WordId>&, WordId, WordId, int);
+	int find(const WordId*) const;
+	WordId sample(int, Random&) const;
+
+	unsigned int size() const;
+	unsigned int getEdgeCount() const;
+	const WordId* getContext(int) const;
+	const vector<NGramEdge>& getEdges(int) const;
+	const vector<NGramEdge>& getRanks(int) const;
+	int getCount(int, WordId) const;
+	int getTotal(int) const;
+
+	void prune(int, int, const vector<bool>&);
+	void clear();
+	size_t getMemoryUsage() const;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Random.cpp: Definition of the Random class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Random.h"
+#include <random>
+#include <chrono>
+#include <thread>
+#include <functional>
+
+using namespace std;
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Private Static Members -----------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Returns a seed for a new thread's engine. The device alone may be deterministic on some
+// platforms, so the thread id and the time are mixed in to keep threads apart.
+unsigned long long Random::localSeed()
+{
+	random_device device;
+
+	return device()
+		^ ((unsigned long long)hash<thread::id>()(this_thread::get_id()) << 1)
+		^ (unsigned long long)chrono::steady_clock::now().time_since_epoch().count();
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes the engine with a fixed seed
+Random::Random()
+{
+	seed(0);
+}
+
+
+// Initializes the engine with the given seed
+Random::Random(unsigned long long value)
+{
+	seed(value);
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Resets the state from the given seed. The seed is spread over the whole state with
+// splitmix64, so similar seeds still give unrelated sequences.
+void Random::seed(unsigned long long value)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		value += 0x9e3779b97f4a7c15ULL;
+
+		unsigned long long z = value;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		state[i] = z ^ (z >> 31);
+	}
+}
+
+
+// Returns the next 64 random bits
+unsigned long long Random::next()
+{
+	unsigned long long result = state[1] * 5;
+	result = ((result << 7) | (result >> 57)) * 9;
+
+	unsigned long long t = state[1] << 17;
+
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+
+	state[2] ^= t;
+	state[3] = (state[3] << 45) | (state[3] >> 19);
+
+	return result;
+}
+
+
+// Returns a random number from 0 up to, but not including, the given bound, by Lemire's
+// multiply and shift. The top half of the product of a random 32-bit number and the bound is
+// spread over the bound almost evenly, but the few products whose bottom half falls below
+// 2 to the 32 modulo the bound would make some numbers more likely than others, so those are
+// drawn again. Only a bottom half below the bound needs the division that finds them, so
+// nearly every call costs one multiplication.
+unsigned int Random::nextInt(unsigned int bound)
+{
+	unsigned long long product = (next() >> 32) * (unsigned long long)bound;
+	unsigned int low = (unsigned int)product;
+
+	if(low < bound)
+	{
+		unsigned int threshold = (0u - bound) % bound;
+
+		while(low < threshold)
+		{
+			product = (next() >> 32) * (unsigned long long)bound;
+			low = (unsigned int)product;
+		}
+	}
+
+	return (unsigned int)(product >> 32);
+}
+
+
+// Returns a random number from 0 up to, but not including, 1, from the top 53 bits of the
+// next number so that every double it can return is equally likely
+double Random::nextDouble()
+{
+	return (next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+// Returns the calling thread's own engine, seeded differently for every thread
+Random& Random::local()
+{
+	thread_local Random random(localSeed());
+
+	return random;
+}
@@ -0,0 +1,47 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Random.h: Declaration of the Random class. A small, fast random number engine.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+// A xoshiro256** random number engine. Each engine has its own state, so unlike rand()
+// any number of threads can draw numbers at once as long as each uses its own engine.
+// Generation takes an engine from the caller, or uses the calling thread's own engine
+// from local() when none is given. An engine seeded the same way always gives the same
+// numbers, on any thread and any platform, so generation from it can be reproduced.
+class Random
+{
+private:
+	unsigned long long state[4];
+
+	static unsigned long long localSeed();
+
+public:
+	Random();
+	Random(unsigned long long);
+
+	void seed(unsigned long long);
+	unsigned long long next();
+	unsigned int nextInt(unsigned int);
+	double nextDouble();
+
+	static Random& local();
+};
+
+#endif
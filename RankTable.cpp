@@ -0,0 +1,112 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * RankTable.cpp: Definition of the RankTable class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RankTable.h"
+#include "MarkovChain.h"
+#include "Word.h"
+#include <algorithm>
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes an empty table. Sampling an empty table returns NULL
+RankTable::RankTable()
+{
+}
+
+
+// Initializes the table from the given links, using the counts of the given direction
+RankTable::RankTable(const WordLinks& links, int direction)
+{
+	build(links, direction);
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Sorts the links with a count in the given direction, GENERATE_PREFIX or GENERATE_POSTFIX,
+// by that count. Words seen equally often are ranked by id, so the most common word is
+// always the same one.
+void RankTable::build(const WordLinks& links, int direction)
+{
+	vector<pair<int, Word*> > ranked;
+
+	for(auto i = links.begin(); i != links.end(); i++)
+	{
+		int count = (direction == GENERATE_PREFIX) ? i->second.prefixOccurrences : i->second.postfixOccurrences;
+		if(count > 0)
+			ranked.push_back(make_pair(count, i->second.word));
+	}
+
+	// The links are in order of id already, so a stable sort keeps ties that way
+	stable_sort(ranked.begin(), ranked.end(), [](const pair<int, Word*>& a, const pair<int, Word*>& b)
+	{
+		return a.first > b.first;
+	});
+
+	words.resize(ranked.size());
+	counts.resize(ranked.size());
+	totals.resize(ranked.size());
+
+	int total = 0;
+	for(unsigned int i = 0; i < ranked.size(); i++)
+	{
+		total += ranked[i].first;
+
+		words[i] = ranked[i].second;
+		counts[i] = ranked[i].first;
+		totals[i] = total;
+	}
+}
+
+
+// Chooses a word by the given policy. Returns NULL if the table is empty
+Word* RankTable::sample(const GenerationPolicy& policy, Random& random) const
+{
+	if(words.empty())
+		return NULL;
+
+	return words[policy.choose(&counts[0], &totals[0], words.size(), random)];
+}
+
+
+// Returns the number of words in the table
+int RankTable::size() const
+{
+	return words.size();
+}
+
+
+// Returns the word of the given rank, 0 being the most common
+Word* RankTable::getWord(int rank) const
+{
+	return words[rank];
+}
+
+
+// Returns the count of the word of the given rank
+int RankTable::getCount(int rank) const
+{
+	return counts[rank];
+}
@@ -0,0 +1,57 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * RankTable.h: Declaration of the RankTable class. A Word's links from most to least common.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RANK_TABLE_H
+#define RANK_TABLE_H
+
+#include "WordLink.h"
+#include "GenerationPolicy.h"
+#include "Random.h"
+#include <vector>
+#include <map>
+
+class Word;
+
+using namespace std;
+
+// The prefix or postfix links of a Word sorted from most to least common, with the running
+// totals of their counts in that order. The k most common words are the first k of the table,
+// so a generation policy can draw from them, or a beam search take them, without looking at
+// the rest. Like an AliasTable, the table is a snapshot, so it must be rebuilt whenever the
+// counts it was built from change.
+class RankTable
+{
+private:
+	// The linked words by rank, and their counts and running totals
+	vector<Word*> words;
+	vector<int> counts;
+	vector<int> totals;
+
+public:
+	RankTable();
+	RankTable(const WordLinks&, int);
+
+	void build(const WordLinks&, int);
+	Word* sample(const GenerationPolicy&, Random&) const;
+	int size() const;
+	Word* getWord(int) const;
+	int getCount(int) const;
+};
+
+#endif
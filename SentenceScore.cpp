@@ -0,0 +1,74 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * SentenceScore.cpp: Definition of the SentenceScore class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SentenceScore.h"
+#include <cmath>
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes the score of a text without words, with a probability of 1
+SentenceScore::SentenceScore()
+{
+	mantissa = 1;
+	exponent = 0;
+	logProbability = 0;
+	perplexity = 1;
+	predictionCount = 0;
+	unknownCount = 0;
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Multiplies in the probability of one prediction: the given count of the predicted link out
+// of the given total, with the given k added to every count of the given number of words.
+// A word with no links has a total of 0, which smoothing spreads evenly over every word.
+void SentenceScore::addPrediction(unsigned int count, unsigned int total, double smoothing, unsigned int vocabulary)
+{
+	double denominator = total + smoothing * vocabulary;
+
+	mantissa *= (denominator > 0) ? (count + smoothing) / denominator : 0;
+	predictionCount++;
+
+	// A product of 0 stays 0, and frexp leaves it so
+	if(mantissa < SCORE_RESCALE_LIMIT)
+	{
+		int shift;
+		mantissa = frexp(mantissa, &shift);
+		exponent += shift;
+	}
+}
+
+
+// Takes the log probability and perplexity of the predictions multiplied in so far
+void SentenceScore::finish()
+{
+	if(mantissa == 0)
+		logProbability = -HUGE_VAL;
+	else
+		logProbability = log(mantissa) + exponent * log(2.0);
+
+	perplexity = (predictionCount == 0) ? 1 : exp(-logProbability / predictionCount);
+}
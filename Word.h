@@ -22,10 +22,18 @@
 #define WORD_H
 
 #include "WordLink.h"
-#include <fstream>
+#include "Dictionary.h"
+#include "Random.h"
+#include <string>
 #include <map>
+#include <atomic>
+#include <vector>
 
 class MarkovChain;
+class AliasTable;
+class CumulativeTable;
+class RankTable;
+class GenerationPolicy;
 
 using namespace std;
 
@@ -34,44 +42,80 @@ using namespace std;
 class Word
 {
 private:
-	// Contains the id of the next word to be created. Incremented with each new word
-	static int nextId;
-
-	// The text of the word
-	string text;
+	// The text of the word. It points into the text interned by the chain's Dictionary
+	string_view text;
 
 	// A collection of all words that have been seen to follow this
-	map<int, WordLink> links;
+	WordLinks links;
 
 	// The number of times this word has occurred in the corpus. This is almost
 	// implicitly, the total count of all postfix occurrences
 	int occurrences;
 
+	// The sums of the postfix and prefix counts of the links. Random words are drawn against
+	// these, so they stay right even after pruning removes links the occurrences counted
+	int postfixTotal;
+	int prefixTotal;
+
+	// The number of links with a postfix count and with a prefix count
+	int postfixFanout;
+	int prefixFanout;
+
 	// Link to the chain this word is in
 	MarkovChain* chain;
 
-	// Unique id for this word to allow indexing without string-based maps
-	int id;
+	// Unique id for this word to allow indexing without string-based maps. This is the
+	// id the chain's Dictionary gave the text, so it's also the Word's index in the chain
+	WordId id;
+
+	// Samplers for the postfix and prefix counts, built the first time they are needed. The
+	// cumulative tables are used in SAMPLE_CUMULATIVE mode and follow every change to the counts
+	// of their direction, new links included. The alias tables are used in SAMPLE_ALIAS mode and
+	// discarded when the counts of their direction change, and so are the rank tables, which
+	// generation policies other than the default use. Several threads generating at once may
+	// race to build a table. The first to publish its table wins and the others throw theirs
+	// away, so building needs no lock.
+	mutable atomic<CumulativeTable*> postfixSums;
+	mutable atomic<CumulativeTable*> prefixSums;
+	mutable atomic<AliasTable*> postfixAlias;
+	mutable atomic<AliasTable*> prefixAlias;
+	mutable atomic<RankTable*> postfixRanks;
+	mutable atomic<RankTable*> prefixRanks;
+
+	template<class Table> Table* getTable(atomic<Table*>&, int) const;
+	bool addLink(Word*, int, int);
+	bool countLink(WordLink&, int, int);
+	Word* sample(int, Random&) const;
+
 public:
-	Word(string, int, MarkovChain*);
-	Word(string, MarkovChain*);
-	Word(char, int, MarkovChain*);
-	Word(char, MarkovChain*);
+	Word(string_view, WordId, MarkovChain*, Arena*);
 	~Word();
 
 	void addOccurrence();
-	int getOccurrences();
-	string getText();
-	int getId();
-
-	void addPostfix(Word*);
-	void addPrefix(Word*);
-	Word* getRandomPostfix();
-	Word* getRandomPrefix();
-	Word* getRandom(int);
-
-	void serialize(ofstream&);
-	void unserialize(ifstream&);
+	void addOccurrences(int);
+	int getOccurrences() const;
+	string_view getText() const;
+	WordId getId() const;
+	const WordLinks& getLinks() const;
+	int getTotal(int) const;
+	int getFanout(int) const;
+
+	bool addPostfix(Word*);
+	bool addPostfix(Word*, int);
+	bool addPrefix(Word*);
+	bool addPrefix(Word*, int);
+	void addLinks(int, const vector<pair<Word*, int> >&);
+	void findWeakLinks(int, int, int, vector<Word*>&) const;
+	void removeLink(WordId, int);
+	void discardTables();
+	Word* getRandomPostfix() const;
+	Word* getRandomPostfix(Random&) const;
+	Word* getRandomPrefix() const;
+	Word* getRandomPrefix(Random&) const;
+	Word* getRandom(int) const;
+	Word* getRandom(int, Random&) const;
+	Word* getRandom(int, const GenerationPolicy&, Random&) const;
+	const RankTable* getRanks(int) const;
 };
 
 #endif
\ No newline at end of file
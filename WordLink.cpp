@@ -36,9 +36,9 @@ WordLink::WordLink()
 
 // Initializes the link with a specific word. All words must use this constructor. If the
 // default was called previously, it must be reinitialized with this one.
-WordLink::WordLink(Word* word) 
-{ 
-	this->word = word; 
-	prefixOccurrences = 0; 
-	postfixOccurrences = 0; 
-}
\ No newline at end of file
+WordLink::WordLink(Word* word)
+{
+	this->word = word;
+	prefixOccurrences = 0;
+	postfixOccurrences = 0;
+}
@@ -20,9 +20,18 @@
 #ifndef WORD_LINK_H
 #define WORD_LINK_H
 
+#include "Arena.h"
 #include <cstdlib>
+#include <map>
 
 class Word;
+class WordLink;
+
+using namespace std;
+
+// The links of a Word, keyed by the id of the linked word. The tree nodes come from the
+// chain's Arena, so building a chain doesn't allocate once per link.
+typedef map<int, WordLink, less<int>, ArenaAllocator<pair<const int, WordLink> > > WordLinks;
 
 // A simple structure containing the number of times a particular word has occurred
 // following another word.